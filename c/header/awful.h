@@ -10,6 +10,19 @@
 /// Max depth of recursion for the awful_eval function
 #define MAX_EVAL (1024)
 
+/** Engines which can be used by awful() to evaluate an
+    expression: the awful_eval token interpreter or the
+    SECD virtual machine which runs compiled code. */
+enum { AWFUL_EVAL, AWFUL_SECD };
+
+/** Engine currently used by awful(): AWFUL_SECD by default. */
+extern int awful_engine;
+
+/** Look for an atom, interned by str_new(), inside a stack of
+    environments: if found, then return the value of the variable,
+    else NONE. */
+extern val_t awful_find(char *t, stack_t env);
+
 /** Interpret a token list, thus a stack whose elements are
     items representing an Awful text, w.r.t. an environment,
     both passed by reference, and return the value with the
@@ -17,9 +30,49 @@
     is NONE. */
 extern val_t awful_eval(stack_t *r_tokens, stack_t env);
 
+/** Apply the closure f, created by awful_eval(), to the n
+    values args and return the result: the nesting of the
+    evaluation grows only while the closure is running. */
+extern val_t awful_apply(val_t f, int n, val_t *args);
+
 /** Interpret the string *text as an Awful expression and
     print the resulting value on the file.
     If an error occurs, a non zero error code is returned. */
 extern int awful(char *text, FILE *file);
 
+/** Same as awful(), but the expression is a token list, as
+    returned by scan() when used with awful_key_find(). */
+extern int awful_run(stack_t tokens, FILE *file);
+
+/** Interpret the string *text as an Awful prelude and bind the
+    names it defines in the top level environment, in which next
+    expressions are evaluated: the names are printed on the file.
+    If an error occurs, a non zero error code is returned and no
+    name is bound. A prelude is an application of a closure literal,
+    as "({x1 ... xn: e} e1, ..., en)", thus a Niceful let or letrec,
+    which binds x1, ..., xn: if e is a prelude then the names it
+    binds are bound too, else e is ignored. */
+extern int awful_prelude(char *text, FILE *file);
+
+/** Same as awful_prelude(), but the prelude is a token list, as
+    returned by scan() when used with awful_key_find(). */
+extern int awful_prelude_run(stack_t tokens, FILE *file);
+
+/** Forget the names bound by all preludes. */
+extern void awful_prelude_drop(void);
+
+/** Write into the image being saved the preludes loaded so far
+    and the top level environment of awful_eval(). */
+extern void awful_save(void);
+
+/** Read from the image being loaded the preludes and the top
+    level environment written by awful_save(). On error an
+    exception is raised. */
+extern void awful_load(void);
+
+/** Print on a file a token list, as accepted by awful_run(),
+    as Awful text: numbers are printed with all the digits
+    needed to read them back. */
+extern void awful_fprint(FILE *f, stack_t tokens);
+
 #endif
@@ -6,12 +6,22 @@
 #include "stack.h"
 #include "val.h"
 
-/** Data type of a pointer to a keyword routine, that is
-    invoked when the keyword is parsed in a tokens list. */
-typedef val_t (*awful_key_t)(stack_t*, stack_t);
+/// Max number of actual parameters taken by a keyword
+#define AWFUL_KEY_MAXARITY (3)
+
+/** Descriptor of a keyword: a KEYWORD token has the address
+    of such a descriptor as value. The routine is invoked with
+    the values of the arity actual parameters following the
+    keyword, already evaluated and stored into an array, and
+    returns the value of the keyword application. */
+typedef struct awful_key_s {
+    char *name;                 ///< keyword name
+    int arity;                  ///< number of actual parameters
+    val_t (*routine)(val_t*);   ///< built-in function
+} *awful_key_t;
 
 /** Check whether the string text is a keyword and if it is
-    then return the pointer of the corresponding routine,
+    then return the pointer of the corresponding descriptor,
     casted to void*, else NULL. The string to check starts
     at text and is n characters long. */
 extern void *awful_key_find(char *text, unsigned n);
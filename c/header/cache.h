@@ -0,0 +1,36 @@
+/** \file cache.h */
+
+#ifndef cache_INC
+#define cache_INC
+
+#include <stddef.h>
+#include <stdio.h>
+#include "stack.h"
+
+/// Default value of cache_budget
+#define CACHE_BUDGET (4ul << 20)
+
+/** Max number of bytes used by the translations stored into the
+    cache: when it is exceeded, the least recently used ones are
+    deleted. If it is 0 then nothing is stored. */
+extern size_t cache_budget;
+
+/** If the translation of the source text has been stored by
+    cache_put(), return a new copy of it, as a token list stored
+    as scan() does, else NULL. */
+extern stack_t cache_get(const char *text);
+
+/** Store the token list tokens as the translation of the source
+    text, to be returned by cache_get(): tokens can only contain
+    numbers, strings, atoms, keywords and delimiters. */
+extern void cache_put(const char *text, stack_t tokens);
+
+/** Set cache_budget to the given number of bytes, deleting the
+    least recently used translations exceeding it. */
+extern void cache_set_budget(size_t bytes);
+
+/** Print on a file the number of translations found and not
+    found by cache_get(), and the memory used by the cache. */
+extern void cache_status(FILE *dump);
+
+#endif
@@ -0,0 +1,46 @@
+/** \file image.h */
+
+#ifndef image_INC
+#define image_INC
+
+#include <stddef.h>
+#include "stack.h"
+#include "val.h"
+
+/** Save into the file name an image of the names bound by the
+    preludes loaded so far, which can be loaded by image_load()
+    instead of loading the preludes again. If an error occurs,
+    a non zero error code is returned. */
+extern int image_save(char *name);
+
+/** Forget the names bound by all preludes and bind the ones
+    saved into the image name by image_save(). If an error occurs,
+    a non zero error code is returned and, if the file could be
+    read, no name is bound. */
+extern int image_load(char *name);
+
+/** Append n bytes starting at p to the image being saved. */
+extern void image_put(const void *p, size_t n);
+
+/** Return the address of the next n bytes of the image being
+    loaded, which may not be aligned: if they exceed the image,
+    an exception is raised. */
+extern void *image_get(size_t n);
+
+/** Return the number of bytes of the image being loaded which
+    have not been read by image_get() yet. */
+extern size_t image_left(void);
+
+/** Return the permanent item s of the image being saved encoded
+    as an index, or the item encoded by image_item_out() into
+    the image being loaded. */
+extern stack_t image_item_out(stack_t s);
+extern stack_t image_item_in(stack_t s);
+
+/** Encode the value *v for the image being saved, or decode
+    the value *v encoded by image_val_out() into the image being
+    loaded. */
+extern void image_val_out(val_t *v);
+extern void image_val_in(val_t *v);
+
+#endif
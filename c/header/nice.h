@@ -10,4 +10,11 @@
     If an error occurs, a non zero error code is returned. */
 extern int nice(char *text, FILE *file);
 
+/** Interpret the string *text as a Niceful prelude, thus a let
+    or letrec expression, and bind the names it defines, as done
+    by awful_prelude(), in which case the expression after the
+    last "in" is ignored: the names are printed on the file.
+    If an error occurs, a non zero error code is returned. */
+extern int nice_prelude(char *text, FILE *file);
+
 #endif
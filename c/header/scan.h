@@ -4,13 +4,14 @@
 #define scan_INC
 
 #include "stack.h"
+#include "val.h"
 
 /** Scan a list of tokens from text, using any character
     in delimiters as delimiter; the key_find function should
-    return the pointer to the subroutine corresponding to a
-    keyword if the text matches with the keyword name, else
-    NULL. It is void* but when needed it is casted to a
-    function pointer of the form val_t (*)(stack_t*, stack_t).
+    return the pointer to the descriptor of a keyword if the
+    text matches with the keyword name, else NULL. It is void*
+    but when needed it is casted to an awful_key_t, as defined
+    in awful_key.h.
 
     Scan returns a tokens list, thus a stack containing the
     list of tokens where the top of the stack contains the
@@ -27,8 +28,44 @@
     - {type:STACK, val:s}
     - {type:CLOSURE, val:s}
     - {type:KEYWORD, val:p}
-    - {type:d} if d is a delimiter (val is ignored)
+    - {type:d} if d is a delimiter: if d is '(' or '{' then
+        its address is the item of the matching ')' or '}'
+        (NULL if there is none).
 */
 stack_t scan(char *text, char *delims, void *key_find(char*,unsigned));
 
+/** Return a copy of a token list not created by scan(), stored
+    as scan() does: its items are consecutive and each '(' and
+    '{' token points to the matching ')' or '}' token. */
+stack_t scan_copy(stack_t tokens);
+
+/** Return a token list whose values are the n values at vals,
+    which are those of a token list without the addresses of
+    the tokens '(' and '{' point to, stored as scan() does. */
+stack_t scan_restore(const val_t *vals, unsigned n);
+
+/// Size of a scan_keys_t table: a power of 2 greater than
+/// the number of keywords
+#define SCAN_KEYS (128)
+
+/** A perfect hash table of keywords: each keyword is stored
+    at the position given by its hash, thus it is found by a
+    single comparison. */
+typedef struct scan_keys_s {
+    unsigned seed;              ///< multiplier used by the hash
+    unsigned maxlen;            ///< length of the longest name
+    char *name[SCAN_KEYS];      ///< keyword names or NULL
+    void *key[SCAN_KEYS];       ///< values of the keywords
+} *scan_keys_t;
+
+/** Store in the table k the n keywords whose names are the
+    strings names[i] and whose values are keys[i], choosing
+    a hash without collisions. */
+void scan_keys(scan_keys_t k, unsigned n, char **names, void **keys);
+
+/** If the n characters at t are the name of a keyword in the
+    table k then return its value, else NULL: a key_find()
+    function, as needed by scan(), can be defined by it. */
+void *scan_keys_find(scan_keys_t k, char *t, unsigned n);
+
 #endif
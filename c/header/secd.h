@@ -0,0 +1,71 @@
+/** \file secd.h */
+
+#ifndef secd_INC
+#define secd_INC
+
+#include <stdio.h>
+#include "stack.h"
+#include "val.h"
+
+/** Code for the SECD machine: a prototype contains the
+    instructions of a closure body or of a whole expression. */
+typedef struct secd_proto_s *secd_proto_t;
+
+/// Default value of secd_budget
+#define SECD_BUDGET (64ul << 20)
+
+/** Max number of bytes used by the stacks of the SECD machine,
+    which grow as needed up to this limit: if it is exceeded an
+    exception is raised. */
+extern size_t secd_budget;
+
+/** Compile a token list, as returned by scan() when used
+    with awful_key_find(), into code for the SECD machine
+    and return it. The code is valid until secd_reset()
+    is called. On error an exception is raised. */
+extern secd_proto_t secd_compile(stack_t tokens);
+
+/** Print on a file a closure created by the SECD machine:
+    c is the stack item the closure value points to. */
+extern void secd_fprint(FILE *f, stack_t c);
+
+/** Delete all code compiled so far, but for the code kept by
+    secd_bind(). */
+extern void secd_reset(void);
+
+/** Bind the names defined by a prelude: tokens is a prelude as
+    accepted by awful_prelude_run(), whose innermost body has been
+    replaced by a closure literal, and h is the closure returned
+    by secd_run() executing the code compiled from tokens. The
+    environment of h becomes the top level environment of the
+    code compiled next: it is copied by stack_keep(), and the
+    code compiled so far is kept. */
+extern void secd_bind(stack_t tokens, val_t h);
+
+/** Delete the top level environment and the code kept by
+    secd_bind(). */
+extern void secd_drop(void);
+
+/** Return the index of the prototype p, kept by secd_bind(), as
+    written into images. */
+extern unsigned secd_index(secd_proto_t p);
+
+/** Return the prototype whose index was i when saved into the
+    image loaded by secd_load(). */
+extern secd_proto_t secd_at(unsigned i);
+
+/** Write into the image being saved the code kept by secd_bind()
+    and the top level environment. */
+extern void secd_save(void);
+
+/** Read from the image being loaded the code and the top level
+    environment written by secd_save(), which is called after
+    secd_drop(). On error an exception is raised. */
+extern void secd_load(void);
+
+/** Execute the code p compiled by secd_compile() and return
+    the value of the expression. On error an exception is
+    raised. */
+extern val_t secd_run(secd_proto_t p);
+
+#endif
@@ -3,6 +3,7 @@
 #ifndef stack_INC
 #define stack_INC
 
+#include <stddef.h>
 #include "val.h"
 
 /** Stack item. */
@@ -26,22 +27,98 @@ extern stack_t stack_dup(stack_t s1, stack_t s2);
 /** Creates a new stack with a single item not initialized. */
 extern stack_t stack_new(void);
 
+/** Creates a vector of n values not initialized: it is a stack
+    item, whose value is the number n, followed by room
+    for the n values, which are accessed by stack_vec(). */
+extern stack_t stack_new_vec(unsigned n);
+
+/** Creates a list of n items not initialized, but for their
+    next items: they are stored at consecutive addresses, the
+    i-th item being followed by the (i+1)-th one, the last one
+    by NULL. If n == 0 then NULL is returned. */
+extern stack_t stack_new_list(unsigned n);
+
+/** Number of items taken by a vector of n values, including
+    its header. */
+extern unsigned stack_vec_items(unsigned n);
+
+/** Address of the first value of a vector s created by
+    stack_new_vec(). */
+#define stack_vec(s) ((val_t*)((s) + 1))
+
+/** Number of values of a vector s created by stack_new_vec(). */
+#define stack_vec_len(s) ((unsigned) val_n((s)->val))
+
 /** Push a value v on the stack s. Return the updated value
     of s. */
 extern stack_t stack_push(stack_t s, val_t v);
 
-/** Push a value v = {STACK, s1} on the stack s.
+/** Push a value of type STACK pointing to s1 on the stack s.
     Return the updated value of s. */
 extern stack_t stack_push_s(stack_t s, stack_t s1);
 
 /** Delete all stack items allocated so far. */
 extern void stack_reset(void);
 
+/** Set to the given number of bytes the size of the nursery,
+    from which new items are taken: the change takes effect when
+    the nursery is empty. */
+extern void stack_set_nursery(size_t bytes);
+
+/** Record that the item s, created before the last collection,
+    has been changed to contain a value, or a next item, which
+    may point to items created after it. */
+extern void stack_remember(stack_t s);
+
+/** Mark the items reachable from the n values at v, which are
+    updated if some of those items are moved: to be called only
+    by the roots() function passed to stack_gc() or stack_keep(). */
+extern void stack_mark(val_t *v, unsigned n);
+
+/** Copy into permanent memory the items reachable from the roots,
+    which are passed by the roots() function to stack_mark(), as
+    done by stack_gc(), and updated to point to the copies. The
+    items copied are not changed, and the strings of atoms and
+    strings are kept by str_keep(). Permanent items are neither
+    freed by stack_reset() nor examined by collections, so that
+    they cannot be changed after being copied. */
+extern void stack_keep(void (*roots)(void));
+
+/** Free all permanent items, when none of them can be referenced
+    any more, and release the strings kept by stack_keep(). */
+extern void stack_drop(void);
+
+/** If items is NULL return the number of permanent items, else
+    copy all of them at items, setting vec[i] to 1 if the i-th
+    one is the header of a vector, else to 0. */
+extern unsigned stack_perm_copy(stack_t items, unsigned char *vec);
+
+/** Return the index of the permanent item s inside the items
+    copied by stack_perm_copy(), plus 1, or 0 if s is NULL. */
+extern unsigned stack_perm_index(stack_t s);
+
+/** Return the address of n new consecutive permanent items, not
+    initialized: the i-th one is the header of a vector if vec[i]
+    is nonzero. */
+extern stack_t stack_perm_new(unsigned n, const unsigned char *vec);
+
+/** Return nonzero if so many items have been allocated since
+    the last collection that another one should be done. */
+extern int stack_gc_due(void);
+
+/** Free all items which cannot be reached from the roots: the
+    roots() function is called, maybe more than once, and has
+    to pass to stack_mark() all values which can point to items
+    in use, as well as to store the updated values. Freed items
+    will be reused by stack_new() and stack_push(). */
+extern void stack_gc(void (*roots)(void));
+
 /** Reverse the order of elements in a stack s:
     the new stack pointer is returned. */
 extern stack_t stack_reverse(stack_t s);
 
-/** Logs on a file the current stack status. */
+/** Logs on a file the current stack status, including
+    statistics about collections. */
 extern void stack_status(FILE *dump);
 
 #include <stdio.h>
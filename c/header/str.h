@@ -15,12 +15,38 @@ extern char *str_cat(const char *s1, const char *s2);
     with length n and returns its address. */
 extern char *str_new(const char *s, size_t n);
 
-/** Resets all strings: don't free them explicitly, that
-    is done by stack_reset() that destroys data inside
-    stack elements. */
+/** Called by stack_reset(), which destroys data inside stack
+    elements, to free the strings not used recently: the other
+    ones are kept, so that they are not created again by next
+    expressions. Don't free strings explicitly. */
 extern void str_reset(void);
 
-/** Print on a file the current string table status. */
+/** Keep the string s, returned by str_new() or str_cat(), from
+    being freed by str_reset(), since it is referenced by values
+    which survive stack_reset(). */
+extern void str_keep(const char *s);
+
+/** Let str_reset() free the strings kept by str_keep() as
+    the other ones. */
+extern void str_release(void);
+
+/** Keep the string s, returned by str_new() or str_cat(), from
+    being freed by str_reset() until str_unref() is called as many
+    times as str_ref(): unlike str_keep(), it is not undone by
+    str_release(). */
+extern void str_ref(const char *s);
+
+/** Undo a call of str_ref() for the string s: once no call is
+    left, s is freed by str_reset() as any other string. */
+extern void str_unref(const char *s);
+
+/** Return the hash of the string s, returned by str_new() or
+    str_cat(): unlike its address, it depends only on the
+    characters of s, so that it is the same in any run. */
+extern unsigned str_hash_of(const char *s);
+
+/** Print on a file the current string table status: the size
+    of strings retained and of those freed so far. */
 extern void str_status(FILE *dump);
 
 /** Return the address of the substring of s which is stripped
@@ -30,4 +56,14 @@ extern void str_status(FILE *dump);
     space from the end of the string. */
 extern char *str_strip(char *s);
 
+/** Return the contents of the file f as a string which can be
+    changed, without copying it if it can be mapped in memory:
+    in that case *r_size is set to the size of the mapping, else
+    to 0 and the string is allocated by malloc(). On error NULL
+    is returned. */
+extern char *str_map(FILE *f, size_t *r_size);
+
+/** Release a string returned by str_map(), of size size. */
+extern void str_unmap(char *s, size_t size);
+
 #endif
@@ -3,8 +3,11 @@
 #ifndef val_INC
 #define val_INC
 
+#include <stdint.h>
 #include <stdio.h>
-#include "stack.h"
+#include <string.h>
+
+struct stack_s;
 
 /** Constants used to encode values or tokens types. */
 enum {
@@ -15,22 +18,101 @@ enum {
     KEYWORD,    // Built-in function type
     STACK,      // Stack type
     CLOSURE,    // Closure type
+    CODE,       // Compiled code (used by the SECD machine)
+    VECTOR,     // Vector type
 };
 
-/** Type containing a single Awful value or token. */
-typedef struct val_s {
-    int type;   /* A constant denoting the type of data: it
-                    can be a NUMBER, etc. constant or a
-                    number between 33 and 127 representing
-                    a single delimiter. */
-    union {
-        char d;             // Used for delimiters
-        double n;           // Number
-        char *t;            // string
-        struct stack_s *s;  // stack or closure
-        void *p;            // Used for keywords
-    } val;
-} val_t;
+/** Type containing a single Awful value or token, NaN-boxed into
+    64 bits: a number is stored as a double, whose NaNs are all
+    turned into the same positive one, while other values are
+    stored as negative NaNs, which have all the 12 upper bits set,
+    followed by a nonzero 4 bits tag and by a 48 bits payload:
+
+    - tag 1: a delimiter, whose character is the payload;
+    - tag 2 or 3: a '(' or '{' token, pointing to the matching
+        ')' or '}' token;
+    - tag 4: a '!' token, or an actual parameter not evaluated yet
+        by awful_eval(), pointing to its first token;
+    - tag 5: a value of type VECTOR, pointing to a vector created
+        by stack_new_vec();
+    - tag 8 + type: a value of type NONE, STRING, ATOM, KEYWORD,
+        STACK, CLOSURE or CODE, whose payload is its address.
+
+    Types are integers, as the constants above or the character
+    of a delimiter: they are read by val_type() and values are
+    created by val_number() and val_make(). Addresses must fit
+    into 48 bits, as on common 64 bits machines. */
+typedef uint64_t val_t;
+
+/// Bits of a value tagged by t
+#define VAL_TAG(t) ((uint64_t)(0xfff0 | (t)) << 48)
+
+/// Bits of the payload of a value
+#define VAL_PAYLOAD (((uint64_t)1 << 48) - 1)
+
+/// The NONE value
+#define VAL_NONE VAL_TAG(8 + NONE)
+
+/// The number NaN
+#define VAL_NAN ((uint64_t)0x7ff8 << 48)
+
+/** Return the type of the value v. */
+static inline int val_type(val_t v)
+{
+    if (v < VAL_TAG(1)) return NUMBER;
+    unsigned t = (v >> 48) & 15;
+    return (t >= 8) ? (int)t - 8 : (t == 1) ? (int)(v & 255)
+        : (t == 2) ? '(' : (t == 3) ? '{' : (t == 4) ? '!' : VECTOR;
+}
+
+/** Return nonzero if v is a number. */
+#define val_is_number(v) ((v) < VAL_TAG(1))
+
+/** Return the number v. */
+static inline double val_n(val_t v)
+{
+    double n;
+    memcpy(&n, &v, sizeof n);
+    return n;
+}
+
+/** Return the address stored into v, which is neither a number
+    nor a delimiter but '(', '{' and '!'. */
+static inline void *val_p(val_t v)
+{
+    return (void*)(uintptr_t)(v & VAL_PAYLOAD);
+}
+
+/// Address stored into v, as a string or a stack item
+#define val_str(v) ((char*) val_p(v))
+#define val_s(v) ((struct stack_s*) val_p(v))
+
+/** Return the value of the number n. */
+static inline val_t val_number(double n)
+{
+    val_t v;
+    if (n != n) return VAL_NAN;
+    memcpy(&v, &n, sizeof v);
+    return v;
+}
+
+/** Return a value of the given type, other than NUMBER, whose
+    address is p, which is ignored by delimiters but '(', '{'
+    and '!'. */
+static inline val_t val_make(int type, const void *p)
+{
+    if (type > VECTOR && type != '(' && type != '{' && type != '!')
+        return VAL_TAG(1) | (unsigned char) type;
+    unsigned t = (type == '(') ? 2 : (type == '{') ? 3 : (type == '!') ? 4
+        : (type == VECTOR) ? 5 : 8 + type;
+    return VAL_TAG(t) | ((uintptr_t) p & VAL_PAYLOAD);
+}
+
+/** Return the value v whose address is replaced by p. */
+static inline val_t val_with_p(val_t v, const void *p)
+{
+    return (v & ~VAL_PAYLOAD) | ((uintptr_t) p & VAL_PAYLOAD);
+}
 
 /** Print a value on a file. */
 extern void val_fprint(FILE *f, val_t v);
@@ -8,50 +8,118 @@
 #include "../header/awful.h"
 #include "../header/awful_key.h"
 #include "../header/except.h"
+#include "../header/image.h"
 #include "../header/repl.h"
 #include "../header/scan.h"
+#include "../header/secd.h"
 #include "../header/stack.h"
 #include "../header/str.h"
 #include "../header/val.h"
 
 static int awful_eval_count = 0;
 
-/** Look for an atom inside a stack of environments: if found,
-    then return a clone of the value of the variable. */
-static val_t awful_find(char *t, stack_t e)
+int awful_engine = AWFUL_SECD;
+
+/** Token lists of the preludes loaded so far, the last one on
+    top, and their number: they are permanent items. */
+static stack_t awful_preludes = NULL;
+static int awful_npreludes = 0;
+
+/** Number of the preludes, starting from the first one, whose
+    names have been bound by each engine: a prelude loaded by an
+    engine is bound by the other one when it is used. */
+static int awful_nbound[2] = {0, 0};
+
+/** Top level environment of awful_eval(), which binds the names
+    defined by preludes: it is made of permanent items. */
+static stack_t awful_top = NULL;
+
+/// Frames binding more than this number of variables are indexed
+#define AWFUL_FIND_INDEX (8)
+
+/// Hash of an interned string, which does not depend on its address,
+/// so that indexes can be saved into images
+#define AWFUL_FIND_HASH(t) str_hash_of(t)
+
+val_t awful_find(char *t, stack_t e)
 {
-    // Expect e to be [name,value,...,name,value]
-    for (; e != NULL; e = e->next)
-        for (stack_t p = e->val.val.s; p != NULL; p = p->next->next)
-            if (strcmp(t, p->val.val.t) == 0)
-                return p->next->val;
-    val_t none = {.type = NONE};
-    return none;
+    /*  Each item of e is either {type:STACK, val:[name,value,...]}
+        or the header of an index created by awful_frame(). Names
+        are interned by str_new(), so that they are compared as
+        addresses. */
+    for (; e != NULL; e = e->next) {
+        if (val_type(e->val) == STACK) {
+            for (stack_t p = val_s(e->val); p != NULL; p = p->next->next)
+                if (val_str(p->val) == t)
+                    return p->next->val;
+        } else {
+            val_t *v = stack_vec(e);
+            unsigned mask = stack_vec_len(e) - 1;
+            for (unsigned h = AWFUL_FIND_HASH(t) & mask; v[h] != VAL_NONE;
+            h = (h + 1) & mask)
+                if (val_str(val_s(v[h])->val) == t)
+                    return val_s(v[h])->next->val;
+        }
+    }
+    return VAL_NONE;
+}
+
+/** Push on env a frame for the list assoc = [name,value,...]
+    with n pairs and return the new environment. If n is large
+    the frame is an index: a vector, created by stack_new_vec(),
+    which is an open addressing hash table whose values are the
+    pairs of assoc, so that values changed inside assoc are seen
+    through the index too. */
+static stack_t awful_frame(stack_t env, stack_t assoc, unsigned n)
+{
+    if (n <= AWFUL_FIND_INDEX)
+        return stack_push_s(env, assoc);
+    unsigned size = 2 * AWFUL_FIND_INDEX;
+    while (size < 2 * n)
+        size *= 2;
+    stack_t index = stack_new_vec(size);
+    val_t *v = stack_vec(index);
+    for (unsigned h = 0; h < size; ++ h)
+        v[h] = VAL_NONE;
+    // The first pair with a given name hides the following ones
+    for (stack_t p = assoc; p != NULL; p = p->next->next) {
+        char *t = val_str(p->val);
+        unsigned h = AWFUL_FIND_HASH(t) & (size - 1);
+        while (v[h] != VAL_NONE && val_str(val_s(v[h])->val) != t)
+            h = (h + 1) & (size - 1);
+        if (v[h] == VAL_NONE)
+            v[h] = val_make(STACK, p);
+    }
+    index->next = env;
+    return index;
 }
 
 /** Parses a sequence of tokens from r_tokens until the
     next "," or ")" is found: the ending ')' or ',' is
-    parsed too but not included in the returned parsed text.
-    Inside the sequence braces and parentheses can be nested. */
+    parsed too but not included in the parsed text, whose
+    first token is returned. The text is not copied: nested
+    parentheses and braces are skipped at once thanks to the
+    matching delimiters found by scan(). */
 static stack_t awful_parse(stack_t *r_tokens)
 {
     stack_t tokens = *r_tokens;
-    except_on(tokens == NULL, "Unexpected end of text in actual parameter");
-    int parentheses = 0;    // '('-')' match counter
-    int braces = 0;         // '{'-'}' match counter
-    stack_t body = NULL;
+    stack_t text = tokens;
     int type;
-    while (((type = tokens->val.type) != ')' && type != ',' || parentheses > 0 || braces > 0)) {
-        parentheses += (type == '(') - (type == ')');
-        braces += (type == '{') - (type == '}');
-        body = stack_dup(tokens, body);
-        tokens = tokens->next;
+    for (;;) {
         except_on(tokens == NULL,
             "Unexpected end of text in actual parameter");
+        if ((type = val_type(tokens->val)) == ')' || type == ',')
+            break;
+        if (type == '(' || type == '{') {
+            tokens = val_s(tokens->val);    // matching ')' or '}'
+            except_on(tokens == NULL,
+                "Unexpected end of text in actual parameter");
+        }
+        tokens = tokens->next;
     }
     tokens = tokens->next;          // skip ')' or ','
     *r_tokens = tokens;
-    return stack_reverse(body);
+    return text;
 }
 
 #ifdef DEBUG
@@ -70,128 +138,140 @@ static int __indent_ = 0;
     parameters and return its value: *r_tokens is the
     "control stack" containing the next symbol to parse,
     a variable or ":", while env contains the current
-    environment.*/
+    environment. If the closure body is an application too,
+    thus a tail call, or the COND of a Niceful conditional,
+    it is parsed by the same loop, so that tail recursive
+    functions use constant C stack. */
 static val_t awful_application(stack_t *r_tokens, stack_t env)
 {
 ENTER
-    // tokens = f [e1 "," ... "," en] ")"
-    val_t f = awful_eval(r_tokens, env);
     stack_t tokens = *r_tokens;
-    except_on(f.type != CLOSURE, "Function expected");
-
-    /*  Notice that closure f is represented as:
-            f.val.s = [[x1...xn] [body] [fenv]]
-            f.val.s.val.s = [x1, ...,xn]
-            f.next.val.s = [body]
-            f.next.next.val.s = [fenv]  */
-    stack_t fparams = f.val.s->val.val.s;
-    stack_t body = f.val.s->next->val.val.s;
-    stack_t fenv = f.val.s->next->next->val.val.s;
-
-    /*  For each formal parameter parse an expression which
-        is its actual parameters: if the formal parameter
-        is marked as NONE, the actual parameter is not
-        parsed but evaluated, else it'll be evaluated after
-        all actual parameters have been parsed. In any case,
-        the result is pushed in assoc.
-        Remember that fparams is a list t1->a1->t2->a2->...
-        where ti is NONE or '!' and ai is the formal
-        parameter name. */
-    stack_t assoc = NULL;
-    for (stack_t p = fparams; p != NULL; p = p->next) {
-        if (p->val.type == NONE) {
-            val_t v = awful_eval(&tokens, env);
-            except_on(tokens->val.type != ','
-                    && tokens->val.type != ')',
-                "')' or ',' expected after actual parameters");
-            tokens = tokens->next;  // skip ')' or ','
+    val_t retval;
+    for (;;) {
+        // tokens = f [e1 "," ... "," en] ")"
+        val_t f = awful_eval(&tokens, env);
+        except_on(val_type(f) != CLOSURE || val_type(val_s(f)->val) != STACK,
+            "Function expected");
+
+        /*  Notice that closure f is represented as a stack item
+            whose value is the "{" token of the closure text
+            and whose next item is fenv, thus:
+                val_s(val_s(f)->val) = ["{", x1, ..., xn, ":", body, "}"]
+                val_s(f)->next = fenv  */
+        stack_t fp = val_s(val_s(f)->val)->next;
+        stack_t fenv = val_s(f)->next;
+
+        /*  For each formal parameter parse an expression which
+            is its actual parameters: if the formal parameter
+            is not marked by '!', the actual parameter is not
+            parsed but evaluated, else it'll be evaluated after
+            all actual parameters have been parsed, and the value
+            {type:'!', val:s}, s being the first token of the
+            actual parameter, is used to denote it. In any case,
+            the result is pushed in assoc. */
+        stack_t assoc = NULL;
+        int n = 0;
+        while (val_type(fp->val) != ':') {
+            val_t v;
+            if (val_type(fp->val) != '!') {
+                v = awful_eval(&tokens, env);
+                except_on(val_type(tokens->val) != ','
+                        && val_type(tokens->val) != ')',
+                    "')' or ',' expected after actual parameters");
+                tokens = tokens->next;  // skip ')' or ','
+            } else {
+                fp = fp->next;          // skip the '!'
+                // awful_parse skip the ending ',' or ')'
+                v = val_make('!', awful_parse(&tokens));
+            }
+            except_on(val_type(fp->val) != ATOM,
+                "Atom expected as closure formal parameter");
             assoc = stack_push(assoc, v);
-        } else {
-            stack_t actual = awful_parse(&tokens);
-            // awful_parse skip the ending ',' or ')'
-            assoc = stack_push_s(assoc, actual);
+            assoc = stack_push(assoc, fp->val);
+            fp = fp->next;
+            ++ n;
         }
-        p = p->next;    // skip the NONE/'!' item
-        assoc = stack_push(assoc, p->val);
-    }
-    /*  Evaluates all expressions, corresponding to formal
-        parameters marked by '!', in the environment env
-        with assoc pushed in front of it. */
-    stack_t new_env = (assoc == NULL) ? env : stack_push_s(env, assoc);
-    for (stack_t ap = assoc, fp = fparams; ap != NULL;
-    ap = ap->next->next, fp = fp->next->next) {
-        if (fp->val.type == '!') {
-            stack_t to_eval = ap->next->val.val.s;
-            /*  Evaluate to_eval and substitute it with the
-                resulting value. */
-            stack_t saved = to_eval;
-            val_t retval = awful_eval(&to_eval, new_env);
-            ap->next->val = retval;
+        stack_t body = fp->next;        // skip ':'
+        if (assoc == NULL) {
+            // A parameterless function is applied as "(f)"
+            except_on(tokens == NULL || val_type(tokens->val) != ')',
+                "')' expected after parameterless function");
+            tokens = tokens->next;
+        }
+        // Only the first application is followed by tokens to parse
+        if (r_tokens != NULL) {
+            *r_tokens = tokens;
+            r_tokens = NULL;
+        }
+        /*  Evaluates all expressions, corresponding to formal
+            parameters marked by '!', in the environment env
+            with assoc pushed in front of it. */
+        stack_t new_env = (assoc == NULL) ? env : awful_frame(env, assoc, n);
+        for (stack_t ap = assoc; ap != NULL; ap = ap->next->next) {
+            if (val_type(ap->next->val) == '!') {
+                stack_t to_eval = val_s(ap->next->val);
+                /*  Evaluate to_eval and substitute it with the
+                    resulting value. */
+                val_t retval = awful_eval(&to_eval, new_env);
+                ap->next->val = retval;
+            }
+        }
+        // The environment in which to evaluate the
+        // closure is [assoc] + fenv.
+        if (fenv != env)
+            new_env = (assoc == NULL) ? fenv : awful_frame(fenv, assoc, n);
+        if (val_type(body->val) != '(') {
+            retval = awful_eval(&body, new_env);
+            break;
         }
+        // Tail call: apply the body in place of the closure
+        tokens = body->next;
+        env = new_env;
     }
-    // The environment in which to evaluate the
-    // closure is [assoc] + fenv.
-    new_env = (assoc == NULL) ? fenv : stack_push_s(fenv, assoc);
-    val_t retval = awful_eval(&body, new_env);
-    *r_tokens = tokens;
 EXIT
     return retval;
 }
 
+val_t awful_apply(val_t f, int n, val_t *args)
+{
+    except_on(val_type(f) != CLOSURE || val_type(val_s(f)->val) != STACK,
+        "Function expected");
+    // The parameters marked by '!' are bound to values as well
+    stack_t fp = val_s(val_s(f)->val)->next;
+    stack_t assoc = NULL;
+    int m = 0;
+    for (; val_type(fp->val) != ':'; fp = fp->next, ++ m) {
+        if (val_type(fp->val) == '!')
+            fp = fp->next;
+        except_on(val_type(fp->val) != ATOM,
+            "Atom expected as closure formal parameter");
+        if (m < n) {
+            assoc = stack_push(assoc, args[m]);
+            assoc = stack_push(assoc, fp->val);
+        }
+    }
+    except_on(m != n, "%i actual parameters expected", m);
+    stack_t body = fp->next;        // skip ':'
+    stack_t fenv = val_s(f)->next;
+    return awful_eval(&body, (n == 0) ? fenv : awful_frame(fenv, assoc, n));
+}
+
 /** Parse a closure and return it: *r_tokens is the
-    "control stack" containing the next symbol to parse,
-    a variable or ":", while env contains the current
-    environment. A closure is a stack of the form
-    [[x1,...,xn],[body],[fenv]], so the returned value
-    is this stack (or NONE in case of error). */
+    "control stack" whose top is the "{" token starting
+    the closure, while env contains the current environment.
+    A closure is a stack item whose value is the "{" token
+    and whose next item is env: its text is neither copied
+    nor parsed, since formal parameters are parsed when the
+    closure is applied, and the "}" ending it has already
+    been found by scan(). */
 static val_t awful_closure(stack_t *r_tokens, stack_t env)
 {
 ENTER
     stack_t tokens = *r_tokens;
-    except_on(tokens == NULL, "Closure expected");
-
-    // tokens = [a1 ... an] ":" ... "}"
-    /*  A formal parameter is actually a couple of consecutive
-        values t,a where t has type NONE or '!' and a is an
-        atom. If t is NONE the parameter shall be evaluated
-        when parsed, else it shall be evaluated after all
-        actual parameters are parsed, thus allowing for
-        recursive definitions. */
-    stack_t params = NULL;
-    while (tokens->val.type != ':') {
-        // A formal parameter can be an atom or !atom
-        // Push NONE or '!' depending on the parameter being
-        // evaluated immediately or delayed.
-        val_t v = {.type = NONE};
-        if (tokens->val.type == '!') {
-            v.type = '!';
-            tokens = tokens->next;
-        }
-        params = stack_push(params, v);
-        except_on(tokens->val.type != ATOM,
-            "Atom expected as closure formal parameter");
-        params = stack_push(params, tokens->val);
-        tokens = tokens->next;
-    }
-    params = stack_reverse(params);
-    tokens = tokens->next;  // skip ':'
-    stack_t body = NULL;
-    int braces = 0;
-    int type;
-    while (tokens != NULL && ((type = tokens->val.type) != '}' || braces > 0)) {
-        braces += (type == '{') - (type == '}');
-        body = stack_dup(tokens, body);
-        tokens = tokens->next;
-    }
-    except_on(tokens == NULL, "'}' expected to end closure body");
-    tokens = tokens->next;  // skip the '}'
-    body = stack_reverse(body);
-    // Creates the closure as a stack [params, body, env]
-    stack_t s = NULL;
-    s = stack_push_s(s, env);
-    s = stack_push_s(s, body);
-    s = stack_push_s(s, params);
-    val_t retval = {.type = CLOSURE, .val.s = s};
+    stack_t end = val_s(tokens->val);   // matching '}'
+    except_on(end == NULL, "'}' expected to end closure body");
+    val_t retval = val_make(CLOSURE, stack_push_s(env, tokens));
+    tokens = end->next;     // skip the '}'
     *r_tokens = tokens;
 EXIT
     return retval;    
@@ -206,28 +286,32 @@ ENTER
     stack_t tokens = *r_tokens;
     except_on(tokens == NULL, "Expression expected");
     
-    val_t retval;
-    switch (tokens->val.type) {
+    val_t retval = VAL_NONE;
+    switch (val_type(tokens->val)) {
     case NUMBER:
     case STRING:
         retval = tokens->val;
         tokens = tokens->next;
         break;
     case ATOM:
-        retval = awful_find(tokens->val.val.t, env);
-        except_on(retval.type == NONE,
-            "Undefined variable %s", tokens->val.val.t);
+        // A '!' value denotes a parameter not evaluated yet
+        retval = awful_find(val_str(tokens->val), env);
+        except_on(retval == VAL_NONE || val_type(retval) == '!',
+            "Undefined variable %s", val_str(tokens->val));
         tokens = tokens->next;
         break;
     case KEYWORD: {
-        // A keyword has the address of its routine as value
-        awful_key_t k = (awful_key_t)tokens->val.val.p;
+        // A keyword has the address of its descriptor as value:
+        // its actual parameters are evaluated before calling it.
+        awful_key_t k = (awful_key_t) val_p(tokens->val);
+        val_t args[AWFUL_KEY_MAXARITY];
         tokens = tokens->next;
-        retval = (*k)(&tokens, env);
+        for (int i = 0; i < k->arity; ++ i)
+            args[i] = awful_eval(&tokens, env);
+        retval = k->routine(args);
         break;
     }
     case '{':
-        tokens = tokens->next;
         retval = awful_closure(&tokens, env);
         break;
     case '(':
@@ -244,17 +328,222 @@ EXIT
     return retval;
 }
 
+/** Print a number so that it is read back by strtod() as the
+    same double, using the least number of digits needed. */
+static void awful_fprint_number(FILE *f, double n)
+{
+    char buf[32];
+    sprintf(buf, "%.15g", n);
+    if (strtod(buf, NULL) != n)
+        sprintf(buf, "%.17g", n);
+    fputs(buf, f);
+}
+
+void awful_fprint(FILE *f, stack_t tokens)
+{
+    int last = ' ';     // type of the previous token
+    for (; tokens != NULL; tokens = tokens->next) {
+        val_t v = tokens->val;
+        // No space after an open delimiter or before a closed one
+        if (last != ' ' && strchr("({:!,", last) == NULL
+        && strchr(")}:,", val_type(v)) == NULL)
+            fputc(' ', f);
+        switch (val_type(v)) {
+        case NUMBER: awful_fprint_number(f, val_n(v)); break;
+        case STRING: {
+            char q = (strchr(val_str(v), '"') == NULL) ? '"' : '\'';
+            fprintf(f, "%c%s%c", q, val_str(v), q);
+            break;
+        }
+        case ATOM: fputs(val_str(v), f); break;
+        case KEYWORD: fputs(((awful_key_t) val_p(v))->name, f); break;
+        default: fputc(val_type(v), f);
+        }
+        last = val_type(v);
+    }
+}
+
+/** Pass to stack_mark() the permanent values of this module. */
+static void awful_keep_roots(void)
+{
+    val_t v[2] = {val_make(STACK, awful_preludes), val_make(STACK, awful_top)};
+    stack_mark(v, 2);
+    awful_preludes = val_s(v[0]);
+    awful_top = val_s(v[1]);
+}
+
+/** Bind by the current engine the names defined by the prelude
+    tokens, whose innermost body has been replaced by awful_hole(),
+    extending the top level environment. */
+static void awful_bind(stack_t tokens)
+{
+    if (awful_engine == AWFUL_SECD) {
+        secd_bind(tokens, secd_run(secd_compile(tokens)));
+    } else {
+        awful_eval_count = 0;
+        val_t h = awful_eval(&tokens, awful_top);
+        except_on(val_type(h) != CLOSURE, "Closure expected binding a prelude");
+        awful_top = val_s(h)->next;
+        stack_keep(awful_keep_roots);
+    }
+}
+
+/** Bind by the current engine the preludes loaded while the other
+    one was in use, from the first one not bound yet: a prelude is
+    considered bound even if an error occurs, so that it is
+    reported only once. */
+static void awful_sync(void)
+{
+    int *r_n = &awful_nbound[awful_engine];
+    while (*r_n < awful_npreludes) {
+        stack_t p = awful_preludes;
+        for (int i = awful_npreludes - 1; i > *r_n; -- i)
+            p = p->next;
+        ++ *r_n;
+        awful_bind(val_s(p->val));
+    }
+}
+
+/** Check that tokens is a prelude, as described in awful.h, and
+    replace the body of its innermost closure by "{:0}", whose
+    value is a closure whose environment binds all names defined
+    by the prelude. */
+static void awful_hole(stack_t tokens)
+{
+    stack_t open;
+    for (;;) {
+        except_on(tokens == NULL || val_type(tokens->val) != '('
+            || tokens->next == NULL || val_type(tokens->next->val) != '{',
+            "Application of a closure literal expected as prelude");
+        open = tokens->next;
+        except_on(val_s(open->val) == NULL, "'}' expected to end closure body");
+        for (tokens = open->next; tokens != NULL && val_type(tokens->val) != ':';
+        tokens = tokens->next)
+            ;
+        except_on(tokens == NULL, "':' expected in closure");
+        stack_t body = tokens->next;
+        if (body == NULL || val_type(body->val) != '(' || body->next == NULL
+        || val_type(body->next->val) != '{')
+            break;
+        tokens = body;
+    }
+    // tokens is the ':' of the innermost closure, which ends with
+    // the '}' open points to
+    stack_t hole = stack_new_list(4);
+    hole[0].val = val_make('{', hole + 3);
+    hole[1].val = val_make(':', NULL);
+    hole[2].val = val_number(0);
+    hole[3].val = val_make('}', NULL);
+    hole[3].next = val_s(open->val);
+    tokens->next = hole;
+}
+
+/** Print on a file the names defined by the prelude tokens,
+    checked by awful_hole(). */
+static void awful_names(stack_t tokens, FILE *file)
+{
+    char *sep = "";
+    // Each closure is followed by its parameters up to ':'
+    while (val_type(tokens->val) == '(' && val_type(tokens->next->val) == '{') {
+        for (tokens = tokens->next->next; val_type(tokens->val) != ':';
+        tokens = tokens->next)
+            if (val_type(tokens->val) == ATOM) {
+                fprintf(file, "%s%s", sep, val_str(tokens->val));
+                sep = " ";
+            }
+        tokens = tokens->next;
+    }
+    if (*sep != '\0') fputc('\n', file);
+}
+
 int awful(char *text, FILE *file)
 {
-    stack_t tokens = NULL;
-    val_t v = {.type = NONE};
+    if (setjmp(except_buf) != 0) {
+        secd_reset();
+        stack_reset();
+        return 1;
+    }
+    return awful_run(scan(text, "(){},:!", awful_key_find), file);
+}
+
+int awful_run(stack_t tokens, FILE *file)
+{
+    // Volatile, so that it keeps its value after an exception
+    volatile val_t v = VAL_NONE;
     if (setjmp(except_buf) == 0) {
-        tokens = scan(text, "(){},:!", awful_key_find);
-        awful_eval_count = 0;
-        v = awful_eval(&tokens, NULL);
-        if (v.type != NONE) val_fprint(file, v);
+        awful_sync();
+        if (awful_engine == AWFUL_SECD) {
+            v = secd_run(secd_compile(tokens));
+        } else {
+            awful_eval_count = 0;
+            v = awful_eval(&tokens, awful_top);
+        }
+        if (v != VAL_NONE) val_fprint(file, v);
         fputc('\n', file);
     }
+    secd_reset();
     stack_reset();
-    return v.type == NONE;
+    return v == VAL_NONE;
+}
+
+int awful_prelude(char *text, FILE *file)
+{
+    if (setjmp(except_buf) != 0) {
+        secd_reset();
+        stack_reset();
+        return 1;
+    }
+    return awful_prelude_run(scan(text, "(){},:!", awful_key_find), file);
+}
+
+int awful_prelude_run(stack_t tokens, FILE *file)
+{
+    stack_t preludes = awful_preludes;
+    volatile int err = 1;
+    if (setjmp(except_buf) == 0) {
+        awful_sync();
+        awful_hole(tokens);
+        // Bind the permanent copy of tokens, which is not moved
+        // by collections done while binding
+        awful_preludes = stack_push_s(awful_preludes, tokens);
+        stack_keep(awful_keep_roots);
+        awful_bind(val_s(awful_preludes->val));
+        awful_nbound[awful_engine] = ++ awful_npreludes;
+        awful_names(val_s(awful_preludes->val), file);
+        err = 0;
+    } else {
+        awful_preludes = preludes;
+    }
+    secd_reset();
+    stack_reset();
+    return err;
+}
+
+void awful_prelude_drop(void)
+{
+    awful_preludes = awful_top = NULL;
+    awful_npreludes = awful_nbound[AWFUL_EVAL] = awful_nbound[AWFUL_SECD] = 0;
+    secd_drop();
+    stack_drop();
+}
+
+void awful_save(void)
+{
+    int h[3] = {awful_npreludes, awful_nbound[0], awful_nbound[1]};
+    image_put(h, sizeof h);
+    stack_t s[2] = {image_item_out(awful_preludes), image_item_out(awful_top)};
+    image_put(s, sizeof s);
+}
+
+void awful_load(void)
+{
+    int h[3];
+    memcpy(h, image_get(sizeof h), sizeof h);
+    awful_npreludes = h[0];
+    awful_nbound[0] = h[1];
+    awful_nbound[1] = h[2];
+    stack_t s[2];
+    memcpy(s, image_get(sizeof s), sizeof s);
+    awful_preludes = image_item_in(s[0]);
+    awful_top = image_item_in(s[1]);
 }
@@ -3,199 +3,430 @@
 /** This submodule of the awful module manages built-in
     functions, aka keywords. */
 
+#include <limits.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include "../header/awful.h"
 #include "../header/awful_key.h"
 #include "../header/except.h"
+#include "../header/scan.h"
 #include "../header/stack.h"
 #include "../header/val.h"
 
-/** Parses two expressions and check their values are numbers. */
+/** Fetch two actual parameters and check they are numbers. */
 #define GETXY() \
-    val_t x = awful_eval(tokens, env);    \
-    except_on(x.type != NUMBER, "Number expected");    \
-    val_t y = awful_eval(tokens, env);    \
-    except_on(y.type != NUMBER, "Number expected");
+    val_t x = args[0];    \
+    except_on(!val_is_number(x), "Number expected");    \
+    val_t y = args[1];    \
+    except_on(!val_is_number(y), "Number expected");
 
-static val_t ADD(stack_t *tokens, stack_t env)
+static val_t ADD(val_t *args)
 {
     GETXY();
-    x.val.n += y.val.n;
-    return x;
+    return val_number(val_n(x) + val_n(y));
 }
 
-static val_t BOS(stack_t *tokens, stack_t env)
+/** Return the number of items of the stack s. */
+static unsigned awful_key_len(stack_t s)
 {
-    val_t x = awful_eval(tokens, env);
-    except_on(x.type != STACK, "BOS x needs x to be a stack");
-    x.val.s = (x.val.s == NULL) ? NULL : x.val.s->next;
-    return x;
+    unsigned n = 0;
+    for (; s != NULL; s = s->next)
+        ++ n;
+    return n;
 }
 
-static val_t COND(stack_t *tokens, stack_t env)
+/** Return the number x as an index of a sequence of n values,
+    raising an error if it is not an integer between 0 and n - 1,
+    or between 0 and n if end is nonzero. */
+static unsigned awful_key_index(val_t x, unsigned n, int end)
 {
-    val_t x = awful_eval(tokens, env);
-    except_on(x.type != NUMBER, "Number expected in COND");
-    val_t y = awful_eval(tokens, env);
-    val_t z = awful_eval(tokens, env);
-    return (x.val.n) ? y : z;
+    except_on(!val_is_number(x), "Number expected as index");
+    double i = val_n(x);
+    except_on(!(i >= 0 && i < (double) n + (end != 0)) || i != (unsigned) i,
+        "Index out of range");
+    return (unsigned) i;
 }
 
-static val_t DIV(stack_t *tokens, stack_t env)
+static val_t APPEND(val_t *args)
+{
+    val_t x = args[0];
+    val_t y = args[1];
+    except_on(val_type(x) != STACK || val_type(y) != STACK,
+        "APPEND x y needs x and y to be stacks");
+    // The items of x are copied into consecutive items
+    unsigned n = awful_key_len(val_s(x));
+    if (n == 0) return y;
+    stack_t s = stack_new_list(n), t = s;
+    for (stack_t r = val_s(x); r != NULL; r = r->next, ++ t)
+        t->val = r->val;
+    s[n - 1].next = val_s(y);
+    return val_make(STACK, s);
+}
+
+static val_t BOS(val_t *args)
+{
+    val_t x = args[0];
+    except_on(val_type(x) != STACK, "BOS x needs x to be a stack");
+    stack_t s = val_s(x);
+    return val_make(STACK, (s == NULL) ? NULL : s->next);
+}
+
+static val_t COND(val_t *args)
+{
+    val_t x = args[0];
+    except_on(!val_is_number(x), "Number expected in COND");
+    return (val_n(x)) ? args[1] : args[2];
+}
+
+static val_t DIV(val_t *args)
 {
     GETXY();
-    x.val.n /= y.val.n;
-    return x;
+    return val_number(val_n(x) / val_n(y));
 }
 
-static val_t EQ(stack_t *tokens, stack_t env)
+static val_t EQ(val_t *args)
 {
-    val_t x = awful_eval(tokens, env);
-    val_t y = awful_eval(tokens, env);
+    val_t x = args[0];
+    val_t y = args[1];
     double flag = 0.0;
-    int type = x.type;
-    if (type == y.type) {
+    int type = val_type(x);
+    if (type == val_type(y)) {
         if (type == NUMBER) {
-            flag = x.val.n == y.val.n;
+            flag = val_n(x) == val_n(y);
         } else {
             except_on(type != STRING, "Can only compare atoms");
-            flag = x.val.t == y.val.t;
+            flag = val_str(x) == val_str(y);
         }
     }
-    x.type = NUMBER;
-    x.val.n = flag;
-    return x;
+    return val_number(flag);
+}
+
+/*  FILTER, FOLD, MAP and SORTBY are compiled by secd.c as loops:
+    these routines are used by awful_eval() only. */
+
+static val_t FILTER(val_t *args)
+{
+    val_t x = args[1];
+    except_on(val_type(x) != STACK, "FILTER f x needs x to be a stack");
+    stack_t h = NULL, *r_t = &h;
+    for (stack_t s = val_s(x); s != NULL; s = s->next) {
+        val_t v = awful_apply(args[0], 1, &s->val);
+        except_on(!val_is_number(v), "FILTER f x needs f to return numbers");
+        if (val_n(v) != 0) {
+            *r_t = stack_push(NULL, s->val);
+            r_t = &(*r_t)->next;
+        }
+    }
+    return val_make(STACK, h);
+}
+
+static val_t FOLD(val_t *args)
+{
+    val_t x = args[2];
+    except_on(val_type(x) != STACK, "FOLD f z x needs x to be a stack");
+    val_t zy[2] = {args[1]};
+    for (stack_t s = val_s(x); s != NULL; s = s->next) {
+        zy[1] = s->val;
+        zy[0] = awful_apply(args[0], 2, zy);
+    }
+    return zy[0];
 }
 
-static val_t GE(stack_t *tokens, stack_t env)
+static val_t GE(val_t *args)
 {
     GETXY();
-    x.val.n = x.val.n >= y.val.n;
-    return x;
+    return val_number(val_n(x) >= val_n(y));
 }
 
-static val_t GT(stack_t *tokens, stack_t env)
+static val_t GT(val_t *args)
 {
     GETXY();
-    x.val.n = x.val.n > y.val.n;
-    return x;
+    return val_number(val_n(x) > val_n(y));
 }
 
-static val_t ISNIL(stack_t *tokens, stack_t env)
+static val_t ISNIL(val_t *args)
 {
-    val_t x = awful_eval(tokens, env);
-    x.val.n = x.type == STACK && x.val.s == NULL;
-    x.type = NUMBER;
-    return x;
+    val_t x = args[0];
+    return val_number(val_type(x) == STACK && val_s(x) == NULL);
 }
 
-static val_t LE(stack_t *tokens, stack_t env)
+static val_t LE(val_t *args)
 {
     GETXY();
-    x.val.n = x.val.n <= y.val.n;
-    return x;
+    return val_number(val_n(x) <= val_n(y));
 }
 
-static val_t LT(stack_t *tokens, stack_t env)
+static val_t LEN(val_t *args)
+{
+    val_t x = args[0];
+    except_on(val_type(x) != STACK, "LEN x needs x to be a stack");
+    return val_number(awful_key_len(val_s(x)));
+}
+
+static val_t LT(val_t *args)
 {
     GETXY();
-    x.val.n = x.val.n < y.val.n;
-    return x;
+    return val_number(val_n(x) < val_n(y));
+}
+
+static val_t MAP(val_t *args)
+{
+    val_t x = args[1];
+    except_on(val_type(x) != STACK, "MAP f x needs x to be a stack");
+    stack_t h = NULL, *r_t = &h;
+    for (stack_t s = val_s(x); s != NULL; s = s->next) {
+        *r_t = stack_push(NULL, awful_apply(args[0], 1, &s->val));
+        r_t = &(*r_t)->next;
+    }
+    return val_make(STACK, h);
 }
 
-static val_t MAX(stack_t *tokens, stack_t env)
+static val_t MAX(val_t *args)
 {
     GETXY();
-    return x.val.n > y.val.n ? x : y;
+    return val_n(x) > val_n(y) ? x : y;
 }
 
-static val_t MIN(stack_t *tokens, stack_t env)
+static val_t MIN(val_t *args)
 {
     GETXY();
-    return x.val.n < y.val.n ? x : y;
+    return val_n(x) < val_n(y) ? x : y;
 }
 
-static val_t MUL(stack_t *tokens, stack_t env)
+static val_t MUL(val_t *args)
 {
     GETXY();
-    x.val.n *= y.val.n;
-    return x;
+    return val_number(val_n(x) * val_n(y));
 }
 
-static val_t NE(stack_t *tokens, stack_t env)
+static val_t NE(val_t *args)
 {
-    val_t retval = EQ(tokens, env);
-    retval.val.n = !retval.val.n;
-    return retval;
+    return val_number(!val_n(EQ(args)));
 }
 
-static val_t NIL(stack_t *tokens, stack_t env)
+static val_t NIL(val_t *args)
 {
-    val_t v = {.type = STACK, .val.s = NULL};
-    return v;
+    (void) args;
+    return val_make(STACK, NULL);
 }
 
-static val_t POW(stack_t *tokens, stack_t env)
+static val_t NTH(val_t *args)
+{
+    val_t x = args[0];
+    except_on(val_type(x) != STACK, "NTH x n needs x to be a stack");
+    stack_t s = val_s(x);
+    for (unsigned i = awful_key_index(args[1], UINT_MAX, 0); i > 0; -- i) {
+        except_on(s == NULL, "Index out of range");
+        s = s->next;
+    }
+    except_on(s == NULL, "Index out of range");
+    return s->val;
+}
+
+static val_t POW(val_t *args)
 {
     GETXY();
-    x.val.n = pow(x.val.n, y.val.n);
-    return x;
+    return val_number(pow(val_n(x), val_n(y)));
 }
 
-static val_t PUSH(stack_t *tokens, stack_t env)
+static val_t PUSH(val_t *args)
 {
-    val_t x = awful_eval(tokens, env);
-    val_t y = awful_eval(tokens, env);
-    except_on(y.type != STACK, "PUSH x y needs y to be a stack");
-    y.val.s = stack_push(y.val.s, x);
-    return y;
+    val_t x = args[0];
+    val_t y = args[1];
+    except_on(val_type(y) != STACK, "PUSH x y needs y to be a stack");
+    return val_make(STACK, stack_push(val_s(y), x));
 }
 
-static val_t SUB(stack_t *tokens, stack_t env)
+static val_t REVERSE(val_t *args)
+{
+    val_t x = args[0];
+    except_on(val_type(x) != STACK, "REVERSE x needs x to be a stack");
+    // The items of x are copied into consecutive items, backwards
+    unsigned n = awful_key_len(val_s(x));
+    if (n == 0) return x;
+    stack_t s = stack_new_list(n), t = s + n;
+    for (stack_t r = val_s(x); r != NULL; r = r->next)
+        (-- t)->val = r->val;
+    return val_make(STACK, s);
+}
+
+/** Sort stably the list s of n items by merging its halves,
+    relinking its items, and return its first item: before(y,x,f)
+    is nonzero if the value y must precede the value x. */
+static stack_t awful_key_msort(stack_t s, unsigned n,
+    int (*before)(val_t, val_t, val_t), val_t f)
+{
+    if (n < 2) return s;
+    stack_t y = s;
+    for (unsigned i = 1; i < n / 2; ++ i)
+        y = y->next;
+    stack_t x = s;
+    s = y->next;
+    y->next = NULL;
+    x = awful_key_msort(x, n / 2, before, f);
+    y = awful_key_msort(s, n - n / 2, before, f);
+    // An item of y is taken only if it precedes the one of x
+    stack_t h = NULL, *r_t = &h;
+    while (x != NULL && y != NULL) {
+        if (before(y->val, x->val, f)) {
+            *r_t = y;
+            y = y->next;
+        } else {
+            *r_t = x;
+            x = x->next;
+        }
+        r_t = &(*r_t)->next;
+    }
+    *r_t = (x != NULL) ? x : y;
+    return h;
+}
+
+/** Return the items of the stack x copied into consecutive ones
+    and sorted by awful_key_msort(). */
+static val_t awful_key_sort(val_t x, int (*before)(val_t, val_t, val_t), val_t f)
+{
+    unsigned n = awful_key_len(val_s(x));
+    stack_t s = stack_new_list(n), t = s;
+    for (stack_t r = val_s(x); r != NULL; r = r->next, ++ t)
+        t->val = r->val;
+    return val_make(STACK, awful_key_msort(s, n, before, f));
+}
+
+/** Return 1 if the number y is less than the number x: f is
+    not used, as by awful_key_sless(). */
+static int awful_key_nless(val_t y, val_t x, val_t f)
+{
+    (void) f;
+    return val_n(y) < val_n(x);
+}
+
+/** Return 1 if the string y precedes the string x. */
+static int awful_key_sless(val_t y, val_t x, val_t f)
+{
+    (void) f;
+    return strcmp(val_str(y), val_str(x)) < 0;
+}
+
+/** Return 1 if the closure f applied to y and x is not zero. */
+static int awful_key_fless(val_t y, val_t x, val_t f)
+{
+    val_t yx[2] = {y, x};
+    val_t v = awful_apply(f, 2, yx);
+    except_on(!val_is_number(v), "SORTBY f x needs f to return numbers");
+    return val_n(v) != 0;
+}
+
+static val_t SORT(val_t *args)
+{
+    val_t x = args[0];
+    except_on(val_type(x) != STACK, "SORT x needs x to be a stack");
+    // Either all numbers or all strings
+    int type = NUMBER;
+    for (stack_t s = val_s(x); s != NULL; s = s->next) {
+        if (s == val_s(x)) type = val_type(s->val);
+        except_on(val_type(s->val) != type || (type != NUMBER && type != STRING),
+            "SORT x needs x to contain only numbers or only strings");
+    }
+    return awful_key_sort(x, (type == STRING) ? awful_key_sless : awful_key_nless,
+        VAL_NONE);
+}
+
+static val_t SORTBY(val_t *args)
+{
+    val_t x = args[1];
+    except_on(val_type(x) != STACK, "SORTBY f x needs x to be a stack");
+    return awful_key_sort(x, awful_key_fless, args[0]);
+}
+
+static val_t SUB(val_t *args)
 {
     GETXY();
-    x.val.n -= y.val.n;
-    return x;
+    return val_number(val_n(x) - val_n(y));
+}
+
+static val_t TOS(val_t *args)
+{
+    val_t x = args[0];
+    except_on(val_type(x) != STACK, "TOS x needs x to be a stack");
+    except_on(val_s(x) == NULL, "TOS applied to an empty stack");
+    return val_s(x)->val;
+}
+
+static val_t VAT(val_t *args)
+{
+    val_t x = args[0];
+    except_on(val_type(x) != VECTOR, "VAT x n needs x to be a vector");
+    stack_t v = val_s(x);
+    return stack_vec(v)[awful_key_index(args[1], stack_vec_len(v), 0)];
+}
+
+static val_t VEC(val_t *args)
+{
+    val_t x = args[0];
+    except_on(val_type(x) != STACK, "VEC x needs x to be a stack");
+    stack_t v = stack_new_vec(awful_key_len(val_s(x)));
+    val_t *w = stack_vec(v);
+    for (stack_t s = val_s(x); s != NULL; s = s->next)
+        *w++ = s->val;
+    return val_make(VECTOR, v);
 }
 
-static val_t TOS(stack_t *tokens, stack_t env)
+static val_t VLEN(val_t *args)
 {
-    val_t x = awful_eval(tokens, env);
-    except_on(x.type != STACK, "TOS x needs x to be a stack");
-    except_on(x.val.s == NULL, "TOS applied to an empty stack");
-    return x.val.s->val;
+    val_t x = args[0];
+    except_on(val_type(x) != VECTOR, "VLEN x needs x to be a vector");
+    return val_number(stack_vec_len(val_s(x)));
 }
 
+static val_t VSLICE(val_t *args)
+{
+    val_t x = args[0];
+    except_on(val_type(x) != VECTOR, "VSLICE x n m needs x to be a vector");
+    stack_t v = val_s(x);
+    unsigned i = awful_key_index(args[1], stack_vec_len(v), 1);
+    unsigned j = awful_key_index(args[2], stack_vec_len(v), 1);
+    except_on(j < i, "Index out of range");
+    stack_t w = stack_new_vec(j - i);
+    memcpy(stack_vec(w), stack_vec(v) + i, (j - i) * sizeof(val_t));
+    return val_make(VECTOR, w);
+}
+
+/** Define the descriptor NAME_key of the keyword NAME which
+    takes N actual parameters. */
+#define KEY(NAME, N) \
+    static struct awful_key_s NAME##_key = {#NAME, N, NAME};
+
+KEY(ADD, 2) KEY(APPEND, 2) KEY(BOS, 1) KEY(COND, 3) KEY(DIV, 2)
+KEY(EQ, 2) KEY(FILTER, 2) KEY(FOLD, 3) KEY(GE, 2) KEY(GT, 2)
+KEY(ISNIL, 1) KEY(LE, 2) KEY(LEN, 1) KEY(LT, 2) KEY(MAP, 2)
+KEY(MAX, 2) KEY(MIN, 2) KEY(MUL, 2) KEY(NE, 2) KEY(NIL, 0)
+KEY(NTH, 2) KEY(POW, 2) KEY(PUSH, 2) KEY(REVERSE, 1) KEY(SORT, 1)
+KEY(SORTBY, 2) KEY(SUB, 2) KEY(TOS, 1) KEY(VAT, 2) KEY(VEC, 1)
+KEY(VLEN, 1) KEY(VSLICE, 3)
+
+/** Descriptors of all keywords. */
+static awful_key_t awful_keys[] = {
+    &ADD_key, &APPEND_key, &BOS_key, &COND_key, &DIV_key,
+    &EQ_key, &FILTER_key, &FOLD_key, &GE_key, &GT_key,
+    &ISNIL_key, &LE_key, &LEN_key, &LT_key, &MAP_key,
+    &MAX_key, &MIN_key, &MUL_key, &NE_key, &NIL_key,
+    &NTH_key, &POW_key, &PUSH_key, &REVERSE_key, &SORT_key,
+    &SORTBY_key, &SUB_key, &TOS_key, &VAT_key, &VEC_key,
+    &VLEN_key, &VSLICE_key
+};
+
+/// Number of keywords
+#define AWFUL_KEYS (sizeof(awful_keys) / sizeof(*awful_keys))
+
 void *awful_key_find(char *t, unsigned n)
 {
-    // Silly and baroque statement replacing a for loop
-    // through a table of pairs (string, addr) or its
-    // unfolding as a sequence of if (memcmp...)
-    return
-        (n == 2) ? (
-            (t[0] == 'E' && t[1] == 'Q') ? EQ:
-            (t[0] == 'G' && t[1] == 'E') ? GE:
-            (t[0] == 'G' && t[1] == 'T') ? GT:
-            (t[0] == 'L' && t[1] == 'E') ? LE:
-            (t[0] == 'L' && t[1] == 'T') ? LT:
-            (t[0] == 'N' && t[1] == 'E') ? NE: NULL) :
-        (n == 3) ? (
-            (t[0] == 'A' && t[1] == 'D' && t[2] == 'D') ? ADD:
-            (t[0] == 'B' && t[1] == 'O' && t[2] == 'S') ? BOS:
-            (t[0] == 'D' && t[1] == 'I' && t[2] == 'V') ? DIV:
-            (t[0] == 'M' && t[1] == 'A' && t[2] == 'X') ? MAX:
-            (t[0] == 'M' && t[1] == 'I' && t[2] == 'N') ? MIN:
-            (t[0] == 'M' && t[1] == 'U' && t[2] == 'L') ? MUL:
-            (t[0] == 'N' && t[1] == 'I' && t[2] == 'L') ? NIL:
-            (t[0] == 'P' && t[1] == 'O' && t[2] == 'W') ? POW:
-            (t[0] == 'S' && t[1] == 'U' && t[2] == 'B') ? SUB:
-            (t[0] == 'T' && t[1] == 'O' && t[2] == 'S') ? TOS: NULL) :
-        (n == 4) ? (
-            (t[0] == 'C' && t[1] == 'O' && t[2] == 'N' && t[3] == 'D') ? COND:
-            (t[0] == 'P' && t[1] == 'U' && t[2] == 'S' && t[3] == 'H') ? PUSH: NULL) :
-        (n == 5) ? (
-            (t[0] == 'I' && t[1] == 'S' && t[2] == 'N' && t[3] == 'I' && t[4] == 'L') ? ISNIL: NULL)
-        : NULL;
+    static struct scan_keys_s keys = {0};
+    if (keys.seed == 0) {
+        char *names[AWFUL_KEYS];
+        for (unsigned i = 0; i < AWFUL_KEYS; ++ i)
+            names[i] = awful_keys[i]->name;
+        scan_keys(&keys, AWFUL_KEYS, names, (void**) awful_keys);
+    }
+    return scan_keys_find(&keys, t, n);
 }
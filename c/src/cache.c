@@ -0,0 +1,185 @@
+/** \file cache.c */
+
+/**
+    The cache maps source texts, as lines typed or read from
+    batch files, to their translations into Awful tokens, so that
+    a text evaluated again is neither scanned nor translated.
+
+    Each entry is a single block containing the values of the
+    tokens and the text: entries are found by a hash table whose
+    elements are lists, as done by str.c, and are linked in a
+    second list, from the most recently used one, from whose end
+    entries are deleted when their size exceeds cache_budget.
+    The strings of atoms and strings used by an entry are kept
+    from being freed by str_ref().
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "../header/cache.h"
+#include "../header/except.h"
+#include "../header/scan.h"
+#include "../header/str.h"
+#include "../header/val.h"
+
+typedef struct cache_s {
+    struct cache_s *next;   ///< next entry with the same hash
+    struct cache_s *newer;  ///< entry used after this one
+    struct cache_s *older;  ///< entry used before this one
+    size_t size;            ///< size of the block
+    unsigned h;             ///< hash of the text
+    unsigned n;             ///< number of tokens
+    val_t *vals;            ///< values of the tokens
+    char text[];            ///< followed by the values
+} *cache_t;
+
+size_t cache_budget = CACHE_BUDGET;
+
+/** Hash table of the entries and its size, a power of 2. */
+static cache_t *cache_table = NULL;
+static unsigned cache_size = 0;
+
+/** Number of entries and bytes they use. */
+static unsigned cache_count = 0;
+static size_t cache_bytes = 0;
+
+/** Most and least recently used entries. */
+static cache_t cache_newest = NULL, cache_oldest = NULL;
+
+/** Number of texts found and not found by cache_get(). */
+static unsigned long cache_hits = 0, cache_misses = 0;
+
+/** Return the FNV-1a hash of the string s. */
+static unsigned cache_hash(const char *s)
+{
+    unsigned h = 2166136261u;
+    while (*s != '\0')
+        h = (h ^ (unsigned char) *s++) * 16777619u;
+    return h;
+}
+
+/** Remove the entry c from the list of recently used ones. */
+static void cache_unlink(cache_t c)
+{
+    if (c->newer != NULL) c->newer->older = c->older;
+    else cache_newest = c->older;
+    if (c->older != NULL) c->older->newer = c->newer;
+    else cache_oldest = c->newer;
+}
+
+/** Insert the entry c as the most recently used one. */
+static void cache_link(cache_t c)
+{
+    c->newer = NULL;
+    c->older = cache_newest;
+    if (cache_newest != NULL) cache_newest->newer = c;
+    else cache_oldest = c;
+    cache_newest = c;
+}
+
+/** Delete the least recently used entry. */
+static void cache_evict(void)
+{
+    cache_t c = cache_oldest;
+    cache_unlink(c);
+    cache_t *r_c = &cache_table[c->h & (cache_size - 1)];
+    while (*r_c != c)
+        r_c = &(*r_c)->next;
+    *r_c = c->next;
+    for (unsigned i = 0; i < c->n; ++ i)
+        if (val_type(c->vals[i]) == ATOM || val_type(c->vals[i]) == STRING)
+            str_unref(val_str(c->vals[i]));
+    -- cache_count;
+    cache_bytes -= c->size;
+    free(c);
+}
+
+/** Double the size of the hash table. */
+static void cache_grow(void)
+{
+    unsigned size = (cache_size > 0) ? 2 * cache_size : 256;
+    cache_t *table = calloc(size, sizeof(cache_t));
+    except_on(table == NULL, "Fatal allocation error"
+        " @%s:%i", __FILE__, __LINE__);
+    for (unsigned i = 0; i < cache_size; ++ i)
+        while (cache_table[i] != NULL) {
+            cache_t c = cache_table[i];
+            cache_table[i] = c->next;
+            c->next = table[c->h & (size - 1)];
+            table[c->h & (size - 1)] = c;
+        }
+    free(cache_table);
+    cache_table = table;
+    cache_size = size;
+}
+
+stack_t cache_get(const char *text)
+{
+    if (cache_count == 0) {
+        ++ cache_misses;
+        return NULL;
+    }
+    unsigned h = cache_hash(text);
+    for (cache_t c = cache_table[h & (cache_size - 1)]; c != NULL; c = c->next)
+        if (c->h == h && strcmp(c->text, text) == 0) {
+            ++ cache_hits;
+            cache_unlink(c);
+            cache_link(c);
+            return scan_restore(c->vals, c->n);
+        }
+    ++ cache_misses;
+    return NULL;
+}
+
+void cache_put(const char *text, stack_t tokens)
+{
+    unsigned n = 0;
+    for (stack_t s = tokens; s != NULL; s = s->next, ++ n)
+        if (val_type(s->val) == STACK || val_type(s->val) == CLOSURE
+        || val_type(s->val) == CODE || val_type(s->val) == VECTOR)
+            return;
+    size_t l = strlen(text) + 1;
+    // Align the values which follow the text
+    size_t vals = offsetof(struct cache_s, text)
+        + (l + sizeof(val_t) - 1) / sizeof(val_t) * sizeof(val_t);
+    size_t size = vals + n * sizeof(val_t);
+    if (size > cache_budget) return;
+    while (cache_bytes + size > cache_budget)
+        cache_evict();
+    cache_t c = malloc(size);
+    if (c == NULL) return;
+    if (cache_count >= cache_size) cache_grow();
+    c->size = size;
+    c->h = cache_hash(text);
+    c->n = n;
+    c->vals = (val_t*)((char*) c + vals);
+    memcpy(c->text, text, l);
+    for (val_t *v = c->vals; tokens != NULL; tokens = tokens->next) {
+        *v = tokens->val;
+        int type = val_type(*v);
+        if (type == ATOM || type == STRING)
+            str_ref(val_str(*v));
+        else if (type == '(' || type == '{')
+            *v = val_with_p(*v, NULL);
+        ++ v;
+    }
+    c->next = cache_table[c->h & (cache_size - 1)];
+    cache_table[c->h & (cache_size - 1)] = c;
+    cache_link(c);
+    ++ cache_count;
+    cache_bytes += size;
+}
+
+void cache_set_budget(size_t bytes)
+{
+    cache_budget = bytes;
+    while (cache_bytes > cache_budget)
+        cache_evict();
+}
+
+void cache_status(FILE *dump)
+{
+    fprintf(dump, "Translation cache: %lu hits, %lu misses, %u entries"
+        " (%zu of %zu Kbytes)\n", cache_hits, cache_misses, cache_count,
+        cache_bytes >> 10, cache_budget >> 10);
+}
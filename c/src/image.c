@@ -0,0 +1,379 @@
+/** \file image.c */
+
+/**
+    An image is a file containing the names bound by the preludes
+    loaded so far: the permanent items which stack_keep() copied
+    them into, the code kept by secd_bind(), the strings they use
+    and the state of the awful module, so that it can be loaded
+    instead of scanning, translating and binding the preludes
+    again.
+
+    The file starts with a header, followed by the strings, each
+    one preceded by its length and followed by '\0', the permanent
+    items, one byte for each of them, which is 1 if it is the header
+    of a vector, and the data written by secd_save() and awful_save().
+    Addresses are replaced by indexes:
+
+    - a string by its position among the strings of the image;
+    - a keyword by the position of its name;
+    - a permanent item by its index as returned by stack_perm_index();
+    - a code prototype by its index as returned by secd_index().
+
+    The image is mapped into memory by str_map(), which does it
+    only if the size of the file is not a multiple of the size of
+    a page: since the latter is even, the file is padded to an odd
+    size. Next the strings are interned and kept, the items are
+    copied into new permanent items, at consecutive addresses,
+    and the values inside them are decoded in place.
+
+    Images depend on the machine and on the version of the
+    interpreter which saved them, which are checked by load.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../header/awful.h"
+#include "../header/awful_key.h"
+#include "../header/except.h"
+#include "../header/image.h"
+#include "../header/secd.h"
+#include "../header/stack.h"
+#include "../header/str.h"
+#include "../header/val.h"
+
+/// First bytes of an image: the last one is the version
+#define IMAGE_MAGIC "AWFULIM2"
+
+/// Number written into the header to check the byte order
+#define IMAGE_CHECK (0x01020304u)
+
+/** Header of an image. */
+typedef struct image_header_s {
+    char magic[8];          ///< IMAGE_MAGIC
+    unsigned check;         ///< IMAGE_CHECK
+    unsigned item;          ///< size of an item
+    unsigned nstrings;      ///< number of strings
+    unsigned nitems;        ///< number of permanent items
+    size_t size;            ///< size of the image, without padding
+} image_header_t;
+
+/** Data of the image being saved, but for the header and the
+    strings, and its length and room. */
+static char *image_buf = NULL;
+static size_t image_len = 0, image_size = 0;
+
+/** Strings of the image being saved, or loaded, by position. */
+static char **image_strings = NULL;
+static unsigned image_nstrings = 0, image_sstrings = 0;
+
+/** Hash table of the positions of the strings of the image
+    being saved, plus 1, by address: its size is image_hsize. */
+static unsigned *image_hash = NULL;
+static unsigned image_hsize = 0;
+
+/** Next byte of the image being loaded, and the end of it. */
+static char *image_at = NULL, *image_end = NULL;
+
+/** Permanent items of the image being loaded, and their number. */
+static stack_t image_items = NULL;
+static unsigned image_nitems = 0;
+
+/** Free the buffers used to save or load an image. */
+static void image_free(void)
+{
+    free(image_buf);
+    free(image_strings);
+    free(image_hash);
+    image_buf = NULL;
+    image_strings = NULL;
+    image_hash = NULL;
+    image_len = image_size = 0;
+    image_nstrings = image_sstrings = image_hsize = 0;
+    image_items = NULL;
+    image_nitems = 0;
+}
+
+/** Grow the array *r_a, of items size bytes long, whose room
+    is *r_size items, so that it contains at least n items. */
+static void image_grow(void *r_a, unsigned *r_size, size_t n, size_t size)
+{
+    if (n <= *r_size) return;
+    unsigned s = (*r_size > 0) ? 2 * *r_size : 1024;
+    while (s < n) s *= 2;
+    void *a = realloc(*(void**)r_a, s * size);
+    except_on(a == NULL, "Fatal allocation error"
+        " @%s:%i", __FILE__, __LINE__);
+    *(void**)r_a = a;
+    *r_size = s;
+}
+
+void image_put(const void *p, size_t n)
+{
+    if (image_len + n > image_size) {
+        size_t size = (image_size > 0) ? image_size : BUFSIZ;
+        while (size < image_len + n) size *= 2;
+        char *buf = realloc(image_buf, size);
+        except_on(buf == NULL, "Fatal allocation error"
+            " @%s:%i", __FILE__, __LINE__);
+        image_buf = buf;
+        image_size = size;
+    }
+    memcpy(image_buf + image_len, p, n);
+    image_len += n;
+}
+
+void *image_get(size_t n)
+{
+    except_on((size_t)(image_end - image_at) < n, "Truncated image");
+    void *p = image_at;
+    image_at += n;
+    return p;
+}
+
+size_t image_left(void)
+{
+    return image_end - image_at;
+}
+
+/** Return the position of the string t among the strings of
+    the image being saved, adding it if not found. */
+static unsigned image_string(char *t)
+{
+    if (2 * (image_nstrings + 1) > image_hsize) {
+        // Rehash into a table twice as large
+        unsigned size = (image_hsize > 0) ? 2 * image_hsize : 1024;
+        unsigned *hash = calloc(size, sizeof(unsigned));
+        except_on(hash == NULL, "Fatal allocation error"
+            " @%s:%i", __FILE__, __LINE__);
+        free(image_hash);
+        image_hash = hash;
+        image_hsize = size;
+        for (unsigned i = 0; i < image_nstrings; ++ i) {
+            unsigned h = str_hash_of(image_strings[i]) & (size - 1);
+            while (hash[h] != 0) h = (h + 1) & (size - 1);
+            hash[h] = i + 1;
+        }
+    }
+    unsigned h = str_hash_of(t) & (image_hsize - 1);
+    for (; image_hash[h] != 0; h = (h + 1) & (image_hsize - 1))
+        if (image_strings[image_hash[h] - 1] == t)
+            return image_hash[h] - 1;
+    image_grow(&image_strings, &image_sstrings, image_nstrings + 1,
+        sizeof(char*));
+    image_strings[image_nstrings] = t;
+    image_hash[h] = image_nstrings + 1;
+    return image_nstrings ++;
+}
+
+stack_t image_item_out(stack_t s)
+{
+    return (stack_t)(uintptr_t) stack_perm_index(s);
+}
+
+stack_t image_item_in(stack_t s)
+{
+    uintptr_t i = (uintptr_t) s;
+    except_on(i > image_nitems, "Corrupted image");
+    return (i == 0) ? NULL : image_items + i - 1;
+}
+
+void image_val_out(val_t *v)
+{
+    uintptr_t i;
+    switch (val_type(*v)) {
+    case NUMBER:
+        return;
+    case STRING:
+    case ATOM:
+        i = image_string(val_str(*v));
+        break;
+    case KEYWORD: {
+        char *name = ((awful_key_t) val_p(*v))->name;
+        i = image_string(str_new(name, strlen(name)));
+        break;
+    }
+    case CODE:
+        i = secd_index(val_p(*v));
+        break;
+    case STACK:
+    case CLOSURE:
+    case VECTOR:
+    case '(':
+    case '{':
+    case '!':
+        i = (uintptr_t) image_item_out(val_s(*v));
+        break;
+    default:
+        return;
+    }
+    *v = val_with_p(*v, (void*) i);
+}
+
+void image_val_in(val_t *v)
+{
+    uintptr_t i = (uintptr_t) val_p(*v);
+    void *p;
+    switch (val_type(*v)) {
+    case STRING:
+    case ATOM:
+        except_on(i >= image_nstrings, "Corrupted image");
+        p = image_strings[i];
+        break;
+    case KEYWORD:
+        except_on(i >= image_nstrings, "Corrupted image");
+        p = awful_key_find(image_strings[i], strlen(image_strings[i]));
+        except_on(p == NULL, "Unknown keyword %s in image",
+            image_strings[i]);
+        break;
+    case CODE:
+        p = secd_at(i);
+        break;
+    case STACK:
+    case CLOSURE:
+    case VECTOR:
+    case '(':
+    case '{':
+    case '!':
+        p = image_item_in((stack_t) i);
+        break;
+    default:
+        return;
+    }
+    *v = val_with_p(*v, p);
+}
+
+/** Apply f to the values of the n items at s, the i-th one being
+    the header of a vector if vec[i] is nonzero, and replace
+    their next items by g(next). */
+static void image_items_fix(stack_t s, unsigned n, const unsigned char *vec,
+    void (*f)(val_t*), stack_t (*g)(stack_t))
+{
+    for (unsigned i = 0; i < n; ) {
+        s[i].next = g(s[i].next);
+        if (vec[i]) {
+            // The header value is the number of values
+            except_on(!val_is_number(s[i].val), "Corrupted image");
+            unsigned k = stack_vec_len(s + i), items = stack_vec_items(k);
+            except_on(items > n - i,
+                "Corrupted image");
+            for (unsigned j = 0; j < k; ++ j)
+                f(stack_vec(s + i) + j);
+            i += items;
+        } else {
+            f(&s[i].val);
+            ++ i;
+        }
+    }
+}
+
+/** Write the image into the file name. */
+static void image_write(char *name)
+{
+    image_header_t h = {IMAGE_MAGIC, IMAGE_CHECK, sizeof(struct stack_s),
+        0, 0, 0};
+    h.nitems = stack_perm_copy(NULL, NULL);
+    unsigned char *vec = malloc(h.nitems + 1);
+    except_on(vec == NULL, "Fatal allocation error"
+        " @%s:%i", __FILE__, __LINE__);
+    stack_t items = malloc(h.nitems * sizeof(struct stack_s) + 1);
+    if (items == NULL) free(vec);
+    except_on(items == NULL, "Fatal allocation error"
+        " @%s:%i", __FILE__, __LINE__);
+    stack_perm_copy(items, vec);
+    image_items_fix(items, h.nitems, vec, image_val_out, image_item_out);
+    image_put(items, h.nitems * sizeof(struct stack_s));
+    image_put(vec, h.nitems);
+    free(items);
+    free(vec);
+    secd_save();
+    awful_save();
+    h.nstrings = image_nstrings;
+    h.size = sizeof h + image_len;
+    for (unsigned i = 0; i < image_nstrings; ++ i)
+        h.size += sizeof(unsigned) + strlen(image_strings[i]) + 1;
+    FILE *f = fopen(name, "wb");
+    except_on(f == NULL, "Cannot write image %s", name);
+    fwrite(&h, sizeof h, 1, f);
+    for (unsigned i = 0; i < image_nstrings; ++ i) {
+        unsigned l = strlen(image_strings[i]);
+        fwrite(&l, sizeof l, 1, f);
+        fwrite(image_strings[i], 1, l + 1, f);
+    }
+    fwrite(image_buf, 1, image_len, f);
+    if (h.size % 2 == 0) fputc('\0', f);
+    int err = ferror(f);
+    err |= fclose(f);
+    except_on(err != 0, "Cannot write image %s", name);
+}
+
+/** Read the image starting at image_at. */
+static void image_read(void)
+{
+    image_header_t h;
+    memcpy(&h, image_get(sizeof h), sizeof h);
+    except_on(memcmp(h.magic, IMAGE_MAGIC, sizeof h.magic) != 0
+        || h.check != IMAGE_CHECK || h.item != sizeof(struct stack_s),
+        "Not an image of this version of the interpreter");
+    except_on(h.size > (size_t)(image_end - image_at) + sizeof h,
+        "Truncated image");
+    image_grow(&image_strings, &image_sstrings, h.nstrings, sizeof(char*));
+    for (; image_nstrings < h.nstrings; ++ image_nstrings) {
+        unsigned l;
+        memcpy(&l, image_get(sizeof l), sizeof l);
+        char *t = image_get((size_t) l + 1);
+        except_on(t[l] != '\0', "Corrupted image");
+        str_keep(image_strings[image_nstrings] = str_new(t, l));
+    }
+    stack_t items = image_get((size_t) h.nitems * sizeof(struct stack_s));
+    unsigned char *vec = image_get(h.nitems);
+    image_items = stack_perm_new(h.nitems, vec);
+    image_nitems = h.nitems;
+    memcpy(image_items, items, (size_t) h.nitems * sizeof(struct stack_s));
+    secd_load();
+    image_items_fix(image_items, h.nitems, vec, image_val_in, image_item_in);
+    awful_load();
+}
+
+int image_save(char *name)
+{
+    if (setjmp(except_buf) != 0) {
+        image_free();
+        return 1;
+    }
+    image_write(name);
+    image_free();
+    return 0;
+}
+
+int image_load(char *name)
+{
+    FILE *f = fopen(name, "rb");
+    if (f == NULL) {
+        perror(name);
+        return 1;
+    }
+    long len = (fseek(f, 0, SEEK_END) == 0) ? ftell(f) : -1;
+    rewind(f);
+    size_t size;
+    char *text = (len >= 0) ? str_map(f, &size) : NULL;
+    fclose(f);
+    if (text == NULL) {
+        perror(name);
+        return 1;
+    }
+    int err = 1;
+    awful_prelude_drop();
+    image_at = text;
+    image_end = text + len;
+    if (setjmp(except_buf) == 0) {
+        image_read();
+        err = 0;
+    } else {
+        awful_prelude_drop();
+    }
+    image_free();
+    str_unmap(text, size);
+    return err;
+}
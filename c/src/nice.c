@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../header/awful.h"
+#include "../header/awful_key.h"
+#include "../header/cache.h"
 #include "../header/except.h"
 #include "../header/nice.h"
 #include "../header/scan.h"
@@ -44,47 +46,32 @@
 #define EMPTY (void*)23
 #define FIRST (void*)24
 #define REST (void*)25
+#define VEC (void*)26
+#define SIZE (void*)27
+
+/** Names of the keywords, in the same order of the constants
+    which denote them. */
+static char *nice_keys[] = {
+    "let", "letrec", "in", "fun", "if", "then", "else", "and", "or",
+    "not", "==", "<>", "<", "<=", ">", ">=", "+", "-", "*", "/", "^",
+    "nil", "empty", "1st", "rest", "vec", "size"
+};
+
+/// Number of keywords
+#define NICE_KEYS (sizeof(nice_keys) / sizeof(*nice_keys))
 
 /** This function is needed by scan() to retrieve a unique code
     associated to each keyword of the language. */
 static void *nice_key_find(char *t, unsigned n)
 {
-    // Silly and baroque statement replacing a for loop
-    // through a table of pairs (string, addr) or its
-    // unfolding as a sequence of if (memcmp...)
-    return
-        (n == 1) ? (
-            (t[0] == '+') ? PLUS:
-            (t[0] == '-') ? MINUS:
-            (t[0] == '*') ? TIMES:
-            (t[0] == '/') ? SLASH:
-            (t[0] == '<') ? LT:
-            (t[0] == '>') ? GT:
-            (t[0] == '^') ? HAT: NULL) :
-        (n == 2) ? (
-            (t[0] == '<' && t[1] == '=') ? LE:
-            (t[0] == '<' && t[1] == '>') ? NE:
-            (t[0] == '=' && t[1] == '=') ? EQ:
-            (t[0] == '>' && t[1] == '=') ? GE:
-            (t[0] == 'i' && t[1] == 'f') ? IF:
-            (t[0] == 'i' && t[1] == 'n') ? IN:
-            (t[0] == 'o' && t[1] == 'r') ? OR: NULL) :
-        (n == 3) ? (
-            (t[0] == '1' && t[1] == 's' && t[2] == 't') ? FIRST:
-            (t[0] == 'a' && t[1] == 'n' && t[2] == 'd') ? AND:
-            (t[0] == 'f' && t[1] == 'u' && t[2] == 'n') ? FUN:
-            (t[0] == 'l' && t[1] == 'e' && t[2] == 't') ? LET:
-            (t[0] == 'n' && t[1] == 'i' && t[2] == 'l') ? NNIL:
-            (t[0] == 'n' && t[1] == 'o' && t[2] == 't') ? NOT: NULL) :
-        (n == 4) ? (
-            (t[0] == 'e' && t[1] == 'l' && t[2] == 's' && t[3] == 'e') ? THEN:
-            (t[0] == 't' && t[1] == 'h' && t[2] == 'e' && t[3] == 'n') ? THEN:
-            (t[0] == 'r' && t[1] == 'e' && t[2] == 's' && t[3] == 't') ? REST: NULL) :
-        (n == 5) ? (
-            (t[0] == 'e' && t[1] == 'm' && t[2] == 'p' && t[3] == 't' && t[4] == 'y') ? EMPTY: NULL) :
-        (n == 6) ? (
-            (t[0] == 'l' && t[1] == 'e' && t[2] == 't' && t[3] == 'r' && t[4] == 'e' && t[5] == 'c') ? LETREC: NULL)
-        : NULL;
+    static struct scan_keys_s keys = {0};
+    if (keys.seed == 0) {
+        void *codes[NICE_KEYS];
+        for (unsigned i = 0; i < NICE_KEYS; ++ i)
+            codes[i] = (void*) (i + 1l);
+        scan_keys(&keys, NICE_KEYS, nice_keys, codes);
+    }
+    return scan_keys_find(&keys, t, n);
 }
 
 /** Raise an error if s is empty, else pop its top and
@@ -95,8 +82,8 @@ static void *nice_key_find(char *t, unsigned n)
 static stack_t nice_expect(stack_t s, char t)
 {
     except_on(s == NULL || (strchr(DELIMITERS, t) != NULL
-            ? s->val.type != t : s->val.type != ATOM
-            || s->val.val.t[0] != t || s->val.val.t[1] != '\0'),
+            ? val_type(s->val) != t : val_type(s->val) != ATOM
+            || val_str(s->val)[0] != t || val_str(s->val)[1] != '\0'),
         "%c expected", t);
     return stack_next(s);
 }
@@ -106,8 +93,8 @@ static stack_t nice_expect(stack_t s, char t)
     dropped is returned. */
 static stack_t nice_expect_key(stack_t s, char *k)
 {
-    if (s == NULL || s->val.type != KEYWORD
-    || s->val.val.p != nice_key_find(k, strlen(k))) {
+    if (s == NULL || val_type(s->val) != KEYWORD
+    || val_p(s->val) != nice_key_find(k, strlen(k))) {
         fputs(k, stderr);
         except_on(1, " expected");
     }
@@ -126,7 +113,7 @@ static val_t nice_more(stack_t s)
     of the stack. */
 static inline int nice_next(stack_t s)
 {
-    return (s != NULL) ? s->val.type : NONE;
+    return (s != NULL) ? val_type(s->val) : NONE;
 }
 
 /*
@@ -156,7 +143,9 @@ static inline int nice_next(stack_t s)
     
     term = number | atom | string | list
         | \-\ term | \1st\ term | \rest\ term 
+        | \vec\ term | \size\ term | keyword \(\ [expr-list] \)\
         | \(\ expression \)\ | term { \(\ [expr-list] \)\ }
+        | term \[\ expression [\,\ expression] \]\
         | \fun\ {atom} \:\ expression
 
     expr-list = expression {\,\ expression}
@@ -168,356 +157,427 @@ static inline int nice_next(stack_t s)
 
     string = \"\{character}\"\ | \'\{character}\'\
     list = \[\ [expr-list] \]\
+    keyword = the name of an Awful keyword, as APPEND
 
 */
 
 // Forward reference
-static char *nice_expression(stack_t *r_nice);
+static void nice_expression(stack_t *r_nice);
 
 #ifdef DEBUG
 // Debug stuff
 static int __indent_ = 0;
 #define RESET __indent_ = 0;
 #define ENTER for (int i=0;i<__indent_;++i)putchar(' ');printf("> %s: ", __func__); stack_fprint(stdout, *r_nice); putchar('\n'); fflush(stdout); ++ __indent_;
-#define EXIT -- __indent_; for (int i=0;i<__indent_;++i)putchar(' ');printf("< %s: %s, ", __func__, awful);stack_fprint(stdout, *r_nice); putchar('\n'); fflush(stdout);
+#define EXIT -- __indent_; for (int i=0;i<__indent_;++i)putchar(' ');printf("< %s: ", __func__);awful_fprint(stdout, nice_out);printf(", ");stack_fprint(stdout, *r_nice); putchar('\n'); fflush(stdout);
 #else
 #define RESET
 #define ENTER
 #define EXIT
 #endif
 
-/** Parse a list from *r_nice into a string which is returned;
+/** The translation is the list of Awful tokens whose first
+    item is nice_out: items are appended to it by the parsing
+    functions, thus a position in the list is represented by
+    the address of the link to the item at that position. */
+static stack_t nice_out = NULL;
+
+/** Position of the end of nice_out. */
+static stack_t *nice_tail = &nice_out;
+
+/** Insert an item with value v in the translation at the
+    position at: this is used to prefix an operator to its
+    first operand, already translated. */
+static void nice_insert(stack_t *at, val_t v)
+{
+    stack_t item = stack_push(*at, v);
+    if (nice_tail == at) nice_tail = &item->next;
+    *at = item;
+}
+
+/** Append an item with value v to the translation. */
+static void nice_put(val_t v)
+{
+    nice_insert(nice_tail, v);
+}
+
+/** Append a delimiter to the translation. */
+static void nice_put_delim(int d)
+{
+    nice_put(val_make(d, NULL));
+}
+
+/** Return the Awful keyword whose name is the string k. */
+static val_t nice_key(char *k)
+{
+    awful_key_t key = awful_key_find(k, strlen(k));
+    except_on(key == NULL, "BUG: %s:%i", __FILE__, __LINE__);
+    return val_make(KEYWORD, key);
+}
+
+/** Append the number n to the translation. */
+static void nice_put_number(double n)
+{
+    nice_put(val_number(n));
+}
+
+/** Parse a list from *r_nice appending its translation;
     the value pointer by r_nice is updated. */
-static char *nice_list(stack_t *r_nice)
+static void nice_list(stack_t *r_nice)
 {
 ENTER
     stack_t nice = stack_next(*r_nice);
-    char *awful = NULL;
     if (nice_next(nice) != ']') {
         // [e1,...,en] -> PUSH e1 PUSH e2 ... PUSH en NIL
         for (;;) {
-            awful = str_cat(awful, " PUSH "); // 1st space important!
-            awful = str_cat(awful, nice_expression(&nice));
+            nice_put(nice_key("PUSH"));
+            nice_expression(&nice);
             if (nice_next(nice) == ']')
                 break;
             nice = nice_expect(nice, ',');
         }
     }
-    awful = str_cat(awful, " NIL");
+    nice_put(nice_key("NIL"));
     nice = stack_next(nice);    // skip ']'
     *r_nice = nice;
 EXIT
-    return awful;
 }
 
-/** Parse a function from *r_nice into a string which is returned;
+/** Parse a function from *r_nice appending its translation;
     the value pointer by r_nice is updated. */
-static char *nice_fun(stack_t *r_nice)
+static void nice_fun(stack_t *r_nice)
 {
     // Transform "x1 ... xn: e" into {x1 ... xn:e}
     stack_t nice = *r_nice;
 ENTER
-    char *awful = str_new("{", 1);
+    nice_put_delim('{');
     for (;;) {
         except_on(nice_next(nice) != ATOM,
             "Atom expected as function formal parameter");
-        awful = str_cat(awful, nice->val.val.t);    // xi
+        nice_put(nice->val);    // xi
         nice = stack_next(nice);
         if (nice_next(nice) == ':')
             break;
-        awful = str_cat(awful, " ");
     }
     nice = stack_next(nice);    // skip ':'
-    awful = str_cat(awful, ":");
-    awful = str_cat(awful, nice_expression(&nice)); // e
-    awful = str_cat(awful, "}");
+    nice_put_delim(':');
+    nice_expression(&nice);     // e
+    nice_put_delim('}');
     
     *r_nice = nice;
 EXIT
-    return awful;
 }
 
-/** Parse an actual parameter list from *r_nice into a string
-    which is returned appended to the left parameter, that
-    should contain the possible function just parsed; the value
+/** Parse an actual parameter list from *r_nice appending its
+    translation to the one of the function just parsed, which
+    is at position start of the translation; the value
     pointed by r_nice is updated. It is assumed that the opening
     '(' has already been parsed. The closing ')' is parsed
     before returning. */
-static char *nice_aparams(stack_t *r_nice, char *awful)
+static void nice_aparams(stack_t *r_nice, stack_t *start)
 {
 ENTER
     stack_t nice = *r_nice;
     do {
         nice = stack_next(nice);    // skip '('
-        // Inserts a "(" on the left of awful
-        char *body = str_new("(", 1);
-        body = str_cat(body, awful);
-        body = str_cat(body, " ");
+        // Inserts a "(" on the left of the function
+        nice_insert(start, val_make('(', NULL));
         for (;;) {
-            body = str_cat(body, nice_expression(&nice));
+            nice_expression(&nice);
             if (nice_next(nice) == ')') {
                 nice = stack_next(nice);    // skip ')'
-                body = str_cat(body, ")");
+                nice_put_delim(')');
                 break;
             } else {
                 nice = nice_expect(nice, ',');
-                body = str_cat(body, ",");
+                nice_put_delim(',');
             }
         }
-        awful = body;
     } while (nice_next(nice) == '(');
     *r_nice = nice;
 EXIT
-    return awful;
 }
 
-/** Parse a term from *r_nice into a string which is returned;
+/** Parse the application of the Awful keyword k from *r_nice,
+    whose name is followed by '(', appending its translation;
+    the value pointed by r_nice is updated. The closing ')' is
+    parsed before returning. */
+static void nice_call(stack_t *r_nice, awful_key_t k)
+{
+ENTER
+    // k(e1,...,en) -> k e1 ... en
+    stack_t nice = stack_next(stack_next(*r_nice));   // skip k and '('
+    nice_put(val_make(KEYWORD, k));
+    for (int i = 0; i < k->arity; ++ i) {
+        if (i > 0) nice = nice_expect(nice, ',');
+        nice_expression(&nice);
+    }
+    *r_nice = nice_expect(nice, ')');
+EXIT
+}
+
+/** Parse an index or a slice from *r_nice appending its
+    translation to the one of the vector just parsed, which is
+    at position start of the translation; the value pointed by
+    r_nice is updated. The closing ']' is parsed before
+    returning. */
+static void nice_index(stack_t *r_nice, stack_t *start)
+{
+ENTER
+    stack_t nice = stack_next(*r_nice);     // skip '['
+    // v[e] -> VAT v e and v[e1,e2] -> VSLICE v e1 e2
+    nice_insert(start, nice_key("VAT"));
+    nice_expression(&nice);
+    if (nice_next(nice) == ',') {
+        (*start)->val = nice_key("VSLICE");
+        nice = stack_next(nice);
+        nice_expression(&nice);
+    }
+    *r_nice = nice_expect(nice, ']');
+EXIT
+}
+
+/** Parse a term from *r_nice appending its translation;
     the value pointer by r_nice is updated. */
-static char *nice_term(stack_t *r_nice)
+static void nice_term(stack_t *r_nice)
 {
-    static char buf[128];
-    char *awful = NULL;
+    stack_t *start = nice_tail;
 ENTER
     stack_t nice = *r_nice;
     except_on(nice == NULL, "Term expected");
-    switch (nice->val.type) {
-        case NUMBER: {
-            sprintf(buf, "%g", nice->val.val.n);
-            awful = str_new(buf, strlen(buf));
-            nice = stack_next(nice);
-            break;
-        }
+    switch (val_type(nice->val)) {
+        case NUMBER:
         case STRING: {
-            buf[0] = (strchr(nice->val.val.t, '"') == NULL) ? '"' : '\'';
-            buf[1] = '\0';
-            awful = str_new(buf, 1);
-            awful = str_cat(awful, nice->val.val.t);
-            awful = str_cat(awful, buf);
+            nice_put(nice->val);
             nice = stack_next(nice);
             break;
         }
         case ATOM: {
-            awful = nice->val.val.t;
-            nice = stack_next(nice);
+            // The name of an Awful keyword followed by '(' applies it
+            char *t = val_str(nice->val);
+            awful_key_t k = awful_key_find(t, strlen(t));
+            if (k != NULL && nice_next(nice->next) == '(') {
+                nice_call(&nice, k);
+            } else {
+                nice_put(nice->val);
+                nice = stack_next(nice);
+            }
             break;
         }
         case '[': {
-            awful = nice_list(&nice);
+            nice_list(&nice);
             break;
         case '(': {
             nice = stack_next(nice);
-            awful = nice_expression(&nice);
+            nice_expression(&nice);
             nice = nice_expect(nice, ')');
             break;
         }
         default:
-            except_on(nice->val.type != KEYWORD, "Syntax error");
-            void *p = nice->val.val.p;
+            except_on(val_type(nice->val) != KEYWORD, "Syntax error");
+            void *p = val_p(nice->val);
             nice = stack_next(nice);
             if (p == MINUS) {
-                awful = str_new("SUB 0 ", 6);
-                awful = str_cat(awful, nice_term(&nice));
+                nice_put(nice_key("SUB"));
+                nice_put_number(0);
+                nice_term(&nice);
             } else
             if (p == FIRST) {
-                awful = str_new("TOS ", 4);
-                awful = str_cat(awful, nice_term(&nice));
+                nice_put(nice_key("TOS"));
+                nice_term(&nice);
             } else
             if (p == REST) {
-                awful = str_new("BOS ", 4);
-                awful = str_cat(awful, nice_term(&nice));
+                nice_put(nice_key("BOS"));
+                nice_term(&nice);
             } else
             if (p == EMPTY) {
-                awful = str_new("ISNIL ", 6);
-                awful = str_cat(awful, nice_term(&nice));
+                nice_put(nice_key("ISNIL"));
+                nice_term(&nice);
             } else
             if (p == NNIL) {
-                awful = str_new("NIL", 3);
+                nice_put(nice_key("NIL"));
+            } else
+            if (p == VEC) {
+                nice_put(nice_key("VEC"));
+                nice_term(&nice);
+            } else
+            if (p == SIZE) {
+                nice_put(nice_key("VLEN"));
+                nice_term(&nice);
             } else
             if (p == FUN) {
-                awful = nice_fun(&nice);
+                nice_fun(&nice);
             } else
                 except_on(1, "Unary operator required");
         }
     }
-    // A term may be followed by a list of actual parameters
-    // enclosed between parentheses.
-    if (nice_next(nice) == '(')
-        awful = nice_aparams(&nice, awful);
+    // A term may be followed by lists of actual parameters
+    // enclosed between parentheses and by indexes enclosed
+    // between brackets.
+    for (;;)
+        if (nice_next(nice) == '(')
+            nice_aparams(&nice, start);
+        else if (nice_next(nice) == '[')
+            nice_index(&nice, start);
+        else
+            break;
     *r_nice = nice;
 EXIT
-    return awful;
 }
 
-/** Parse a Niceful power from *r_nice and return a string
-    containing the corresponding awful expression. Parsed token
+/** Parse a Niceful power from *r_nice and append the
+    corresponding awful expression. Parsed token
     stack elements are deleted. */
-static char *nice_power(stack_t *r_nice)
+static void nice_power(stack_t *r_nice)
 {
 ENTER
     stack_t nice = *r_nice;
-    char *awful;
-    char *e = nice_term(&nice);
-    if (nice == NULL || nice->val.val.p != HAT) awful = e;
-    else {
+    stack_t *start = nice_tail;
+    nice_term(&nice);
+    if (nice != NULL && val_p(nice->val) == HAT) {
         nice = stack_next(nice);    // skip the operator
-        awful = str_new("POW ", 4);
-        awful = str_cat(awful, e);
-        awful = str_cat(awful, " ");
-        awful = str_cat(awful, nice_term(&nice));
+        nice_insert(start, nice_key("POW"));
+        nice_term(&nice);
     }
     *r_nice = nice;
 EXIT
-    return awful;
 }
 
-/** Parse a Niceful product from *r_nice and return a string
-    containing the corresponding awful expression. Parsed token
+/** Parse a Niceful product from *r_nice and append the
+    corresponding awful expression. Parsed token
     stack elements are deleted. */
-static char *nice_product(stack_t *r_nice)
+static void nice_product(stack_t *r_nice)
 {
 ENTER
     stack_t nice = *r_nice;
-    char *awful;
-    char *e = nice_power(&nice);
+    stack_t *start = nice_tail;
+    nice_power(&nice);
     if (nice_next(nice) == ':') {
         nice = stack_next(nice);    // skip the operator
-        awful = str_new("PUSH ", 5);
-        awful = str_cat(awful, e);
-        awful = str_cat(awful, " ");
-        awful = str_cat(awful, nice_product(&nice));
+        nice_insert(start, nice_key("PUSH"));
+        nice_product(&nice);
     } else {
         int is_key = nice_next(nice) == KEYWORD;
         char *opt =
-            (is_key && nice->val.val.p == TIMES) ? "MUL " :
-            (is_key && nice->val.val.p == SLASH) ? "DIV " : NULL;
-        if (opt == NULL) awful = e;
-        else {
+            (is_key && val_p(nice->val) == TIMES) ? "MUL" :
+            (is_key && val_p(nice->val) == SLASH) ? "DIV" : NULL;
+        if (opt != NULL) {
             nice = stack_next(nice);    // skip the operator
-            awful = str_new(opt, strlen(opt));
-            awful = str_cat(awful, e);
-            awful = str_cat(awful, " ");
-            awful = str_cat(awful, nice_product(&nice));
+            nice_insert(start, nice_key(opt));
+            nice_product(&nice);
         }
     }
     *r_nice = nice;
 EXIT
-    return awful;
 }
 
-/** Parse a Niceful sum from *r_nice and return a string
-    containing the corresponding awful expression. Parsed token
+/** Parse a Niceful sum from *r_nice and append the
+    corresponding awful expression. Parsed token
     stack elements are deleted. */
-static char *nice_sum(stack_t *r_nice)
+static void nice_sum(stack_t *r_nice)
 {
 ENTER
     stack_t nice = *r_nice;
-    char *awful;
-    char *e = nice_product(&nice);
+    stack_t *start = nice_tail;
+    nice_product(&nice);
     int is_key = nice_next(nice) == KEYWORD;
     char *opt =
-        (is_key && nice->val.val.p == PLUS) ? "ADD " :
-        (is_key && nice->val.val.p == MINUS) ? "SUB " : NULL;
-    if (opt == NULL) awful = e;
-    else {
+        (is_key && val_p(nice->val) == PLUS) ? "ADD" :
+        (is_key && val_p(nice->val) == MINUS) ? "SUB" : NULL;
+    if (opt != NULL) {
         nice = stack_next(nice);    // skip the operator
-        awful = str_new(opt, strlen(opt));
-        awful = str_cat(awful, e);
-        awful = str_cat(awful, " ");
-        awful = str_cat(awful, nice_sum(&nice));
+        nice_insert(start, nice_key(opt));
+        nice_sum(&nice);
     }
     *r_nice = nice;
 EXIT
-    return awful;
 }
 
-/** Parse a Niceful relation from *r_nice and return a string
-    containing the corresponding awful expression. Parsed token
+/** Parse a Niceful relation from *r_nice and append the
+    corresponding awful expression. Parsed token
     stack elements are deleted. */
-static char *nice_relation(stack_t *r_nice)
+static void nice_relation(stack_t *r_nice)
 {
 ENTER
     stack_t nice = *r_nice;
-    char *awful;
-    if (nice_more(nice).val.p == NOT) {
-        awful = str_new("EQ 0 ", 5);
-        awful = str_cat(awful, nice_relation(&nice));
+    if (val_p(nice_more(nice)) == NOT) {
+        nice = stack_next(nice);    // skip the operator
+        nice_put(nice_key("EQ"));
+        nice_put_number(0);
+        nice_relation(&nice);
     } else {
-        char *e = nice_sum(&nice);
+        stack_t *start = nice_tail;
+        nice_sum(&nice);
         int is_key = nice_next(nice) == KEYWORD;
         char *opt =
-            (nice_next(nice) == ATOM && strcmp(nice->val.val.t, "=") == 0
-                || is_key && nice->val.val.p == EQ) ? "EQ ":
-            (is_key && nice->val.val.p == NE) ? "NE ":
-            (is_key && nice->val.val.p == LT) ? "LT ":
-            (is_key && nice->val.val.p == LE) ? "LE ":
-            (is_key && nice->val.val.p == GT) ? "GT ":
-            (is_key && nice->val.val.p == GE) ? "GE ": NULL;
-        if (opt == NULL) awful = e;
-        else {
+            (nice_next(nice) == ATOM && strcmp(val_str(nice->val), "=") == 0
+                || is_key && val_p(nice->val) == EQ) ? "EQ":
+            (is_key && val_p(nice->val) == NE) ? "NE":
+            (is_key && val_p(nice->val) == LT) ? "LT":
+            (is_key && val_p(nice->val) == LE) ? "LE":
+            (is_key && val_p(nice->val) == GT) ? "GT":
+            (is_key && val_p(nice->val) == GE) ? "GE": NULL;
+        if (opt != NULL) {
             nice = stack_next(nice);    // skip the operator
-            awful = str_new(opt, strlen(opt));
-            awful = str_cat(awful, e);
-            awful = str_cat(awful, " ");
-            awful = str_cat(awful, nice_sum(&nice));
+            nice_insert(start, nice_key(opt));
+            nice_sum(&nice);
         }
     }
     *r_nice = nice;
 EXIT
-    return awful;
 }
 
-/** Parse a Niceful proposition from *r_nice and return a string
-    containing the corresponding awful expression. Parsed token
+/** Parse a Niceful proposition from *r_nice and append the
+    corresponding awful expression. Parsed token
     stack elements are deleted. */
-static char *nice_proposition(stack_t *r_nice)
+static void nice_proposition(stack_t *r_nice)
 {
 ENTER
     stack_t nice = *r_nice;
-    char *awful;
-    char *e = nice_relation(&nice);
+    stack_t *start = nice_tail;
+    nice_relation(&nice);
     int is_key = nice_next(nice) == KEYWORD;
     char *opt =
-        (is_key && nice->val.val.p == OR) ? "MAX " :
-        (is_key && nice->val.val.p == AND) ? "MIN " : NULL;
-    if (opt == NULL) awful = e;
-    else {
+        (is_key && val_p(nice->val) == OR) ? "MAX" :
+        (is_key && val_p(nice->val) == AND) ? "MIN" : NULL;
+    if (opt != NULL) {
         nice = stack_next(nice);    // skip the operator
-        awful = str_new(opt, strlen(opt));
-        awful = str_cat(awful, e);
-        awful = str_cat(awful, " ");
-        awful = str_cat(awful, nice_proposition(&nice));
+        nice_insert(start, nice_key(opt));
+        nice_proposition(&nice);
     }
     *r_nice = nice;
 EXIT
-    return awful;
 }
 
-/** Parse a Niceful conditional from *r_nice and returns a string
-    containing the corresponding awful expression. Parsed token
+/** Parse a Niceful conditional from *r_nice and append the
+    corresponding awful expression. Parsed token
     stack elements are deleted. */
-static char *nice_conditional(stack_t *r_nice)
+static void nice_conditional(stack_t *r_nice)
 {
 ENTER
     stack_t nice = *r_nice;
-    char *awful;
-    if (nice_more(nice).type != KEYWORD || nice->val.val.p != IF)
-        awful = nice_proposition(&nice);
+    if (val_type(nice_more(nice)) != KEYWORD || val_p(nice->val) != IF)
+        nice_proposition(&nice);
     else {
         // Transform "IF e1 e2 e3" into (COND e1{:e2}{:e3})
         nice = stack_next(nice);    // skip IF
-        awful = str_new("(COND ", 6);
-        awful = str_cat(awful, nice_proposition(&nice));  // e1
+        nice_put_delim('(');
+        nice_put(nice_key("COND"));
+        nice_proposition(&nice);    // e1
         nice = nice_expect_key(nice, "then");
-        awful = str_cat(awful, "{:");
-        awful = str_cat(awful, nice_expression(&nice));  // e2
-        awful = str_cat(awful, "}{:");
+        nice_put_delim('{');
+        nice_put_delim(':');
+        nice_expression(&nice);     // e2
+        nice_put_delim('}');
+        nice_put_delim('{');
+        nice_put_delim(':');
         nice = nice_expect_key(nice, "else");
-        awful = str_cat(awful, nice_expression(&nice));  // e3
-        awful = str_cat(awful, "})");
+        nice_expression(&nice);     // e3
+        nice_put_delim('}');
+        nice_put_delim(')');
     }
     *r_nice = nice;
 EXIT
-    return awful;
 }
 
 /** Transform "let x1 = v1, ..., xn = vn in e" into
@@ -527,73 +587,79 @@ EXIT
     Assume that the "let" or "letrec" keyword has NOT
     been parsed, (rec == 1 in case of "letrec").
 */
-static char *nice_let(stack_t *r_nice, int rec)
+static void nice_let(stack_t *r_nice, int rec)
 {
 ENTER
     stack_t nice = stack_next(*r_nice); // skip let/letrec
-    
-    /*  POSSIBILE OTTIMIZZAZIONE: DEFINISCI UN TIPO DI DATO
-        buf CHE CONTIENE STRINGHE TEMPORANEE: LO USI PER LE
-        STRINGHE awful COSI' NON HAI BISOGNO DI ALLOCARE
-        SPAZIO NELLA TAVOLA DELLE STRINGHE.
-    
-        ALLOCHI UN BUFFER CON buf_new(s) DOVE s E' UNA
-        STRINGA C. CON LA FUNZIONE
-    
-            s = buf_add(s, t)
-        
-        SI CONCATENA t IN FONDO A s.
-    
-        QUANDO SI E' FINITO, SI USA buf_del(s) PER
-        CANCELLARE LA STRINGA.
-    */
-    
-    char *awful = str_new("({", 2);
-    char *values = NULL;    // actual parameters list
+    // Actual parameters are moved from the translation to here
+    stack_t values = NULL;
+    stack_t *values_tail = &values;
+    nice_put_delim('(');
+    nice_put_delim('{');
     for (;;) {
         except_on(nice_next(nice) != ATOM,
             "Variables in let/letrec should be atoms");
-        if (rec) awful = str_cat(awful, "!");
-        awful = str_cat(awful, nice->val.val.t);   // variable xi
+        if (rec) nice_put_delim('!');
+        nice_put(nice->val);    // variable xi
         nice = nice_expect(stack_next(nice), '=');
-        values = str_cat(values, nice_conditional(&nice));
-        if (nice_more(nice).val.p == IN) {
+        stack_t *start = nice_tail;
+        nice_conditional(&nice);
+        *values_tail = *start;
+        values_tail = nice_tail;
+        *start = NULL;
+        nice_tail = start;
+        if (val_p(nice_more(nice)) == IN) {
             nice = stack_next(nice);
             break;
         }
         nice = nice_expect(nice, ',');
-        values = str_cat(values, ",");
-        awful = str_cat(awful, " ");
+        *values_tail = stack_push(NULL, val_make(',', NULL));
+        values_tail = &(*values_tail)->next;
     }
     /*  Here all pairs xi = vi are parsed, the list of formal
-        parameters x1 ... xn dumped on awful and the list of
-        actual parameters dumped on value: we close it by ')' */
-    //values = str_cat(values, ")");
-    awful = str_cat(awful, ":");
-    awful = str_cat(awful, nice_expression(&nice));    // body
-    awful = str_cat(awful, "}");
-    awful = str_cat(awful, values);         // actual parameters
-    awful = str_cat(awful, ")");
+        parameters x1 ... xn dumped on the translation and the
+        list of actual parameters saved on values. */
+    nice_put_delim(':');
+    nice_expression(&nice);     // body
+    nice_put_delim('}');
+    *nice_tail = values;
+    nice_tail = values_tail;
+    nice_put_delim(')');
     *r_nice = nice;
 EXIT
-    return awful;
 }
 
-/** Parse a Niceful expression from *r_nice and return a string
-    containing the corresponding awful expression. Parsed token
+/** Parse a Niceful expression from *r_nice and append the
+    corresponding awful expression. Parsed token
     stack elements are deleted. */
-static char *nice_expression(stack_t *r_nice)
+static void nice_expression(stack_t *r_nice)
 {
 ENTER
     stack_t nice = *r_nice;
     int is_key = (nice_next(nice) == KEYWORD);
-    char *awful =
-        (is_key && nice->val.val.p == LET) ? nice_let(&nice, 0) :
-        (is_key && nice->val.val.p == LETREC) ? nice_let(&nice, 1) :
-            nice_conditional(&nice);
+    if (is_key && val_p(nice->val) == LET) nice_let(&nice, 0);
+    else if (is_key && val_p(nice->val) == LETREC) nice_let(&nice, 1);
+    else nice_conditional(&nice);
     *r_nice = nice;
 EXIT
-    return awful;
+}
+
+/** Translate the Niceful expression at tokens into a list of
+    Awful tokens, stored at nice_out: tokens following the
+    expression are ignored, with a warning. */
+static void nice_translate(stack_t tokens)
+{
+    nice_out = NULL;
+    nice_tail = &nice_out;
+    nice_expression(&tokens);
+    if (tokens != NULL) {
+        fprintf(stderr, "Warning: text after expression shall be ignored:");
+        while (tokens != NULL) {
+            fputc(' ', stderr);
+            val_fprint(stderr, tokens->val);
+            tokens = stack_next(tokens); }
+        fputc('\n', stderr);
+    }
 }
 
 int nice(char *text, FILE *file)
@@ -601,26 +667,32 @@ int nice(char *text, FILE *file)
 RESET
     int err = 1;
     if (setjmp(except_buf) == 0) {
-        stack_t tokens = scan(text, DELIMITERS, nice_key_find);
+        // A text translated before is neither scanned nor translated
+        stack_t tokens = cache_get(text);
+        if (tokens != NULL) return awful_run(tokens, file);
+        tokens = scan(text, DELIMITERS, nice_key_find);
         /* If the text starts with "awful" then the user is asking
             not to evaluate it but to translate it into awful. */
-        int translate = tokens != NULL && tokens->val.type == ATOM
-        && strcmp(tokens->val.val.t, "awful") == 0;
+        int translate = tokens != NULL && val_type(tokens->val) == ATOM
+        && strcmp(val_str(tokens->val), "awful") == 0;
         if (translate) tokens = tokens->next;   // skip "awful"
-        char *t = nice_expression(&tokens);
-        if (tokens != NULL) {
-            fprintf(stderr, "Warning: text after expression shall be ignored:");
-            while (tokens != NULL) {
-                fputc(' ', stderr);
-                val_fprint(stderr, tokens->val);
-                tokens = stack_next(tokens); }
-            fputc('\n', stderr);
-        }
-        err = (t == NULL);
-        if (!err) {
-            if (translate) fprintf(file, "%s\n", t);
-            else err = awful(t, file);
+        nice_translate(tokens);
+        if (translate) {
+            awful_fprint(file, nice_out);
+            fputc('\n', file);
+            err = 0;
+        } else {
+            cache_put(text, nice_out);
+            err = awful_run(scan_copy(nice_out), file);
         }
     }
     return err;
 }
+
+int nice_prelude(char *text, FILE *file)
+{
+RESET
+    if (setjmp(except_buf) != 0) return 1;
+    nice_translate(scan(text, DELIMITERS, nice_key_find));
+    return awful_prelude_run(scan_copy(nice_out), file);
+}
@@ -9,13 +9,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../header/awful.h"
+#include "../header/cache.h"
+#include "../header/image.h"
 #include "../header/nice.h"
+#include "../header/secd.h"
+#include "../header/stack.h"
 #include "../header/str.h"
 
-#define repl_BUFSIZ (65536)
+/** Buffer used to read lines from files and to join those ending
+    with '\\': it is enlarged as needed. */
+static char *repl_buf = NULL;
 
-/** Buffer used to join lines ending with '\\' */
-static char repl_buf[repl_BUFSIZ];
+/** Number of bytes allocated for repl_buf. */
+static size_t repl_size = 0;
 
 /** File where output is printed. */
 static FILE *repl_out = NULL;
@@ -26,41 +32,107 @@ static int repl_line = 0;
 /** Current evaluation function: awful or niceful. */
 static int (*repl_eval)(char*, FILE*) = nice;
 
+/** Function loading preludes in the current language. */
+static int (*repl_define)(char*, FILE*) = nice_prelude;
+
+/** Source of the lines read by repl(): either a file, whose
+    lines are read into repl_buf, or a text in memory, as a
+    batch file is, whose lines are read in place. */
+typedef struct repl_src_s {
+    FILE *in;       ///< file, or NULL
+    char *text;     ///< text still to read, if in == NULL
+} *repl_src_t;
+
+/** Make room in repl_buf for n more characters after the
+    first len ones. */
+static void repl_room(size_t len, size_t n)
+{
+    if (len + n <= repl_size) return;
+    size_t size = (repl_size == 0) ? BUFSIZ : repl_size;
+    while (len + n > size) size *= 2;
+    char *buf = realloc(repl_buf, size);
+    assert(buf || !fputs("Malloc error (this is weird)", stderr));
+    repl_buf = buf;
+    repl_size = size;
+}
+
 /** Gets a line from a file. If prompt != NULL then it is
-    printed on repl_out: the scanned line is stored at repl_buf
-    if cat == 0, else it is appended to the string already
-    in repl_buf. In any case, the address of the last inserted
-    line is returned; if an error, or the end of the file,
-    occurs, NULL is returned. */
-static char *repl_get(FILE *in, const char *prompt, int cat)
+    printed on repl_out: the scanned line is stored at repl_buf,
+    whose address is returned; if an error, or the end of the
+    file, occurs, NULL is returned. */
+static char *repl_fget(FILE *in, const char *prompt)
 {
     char *p;
     char c = ':';       // becomes '|' in multiple lines
-    if (cat == 0) repl_buf[0] = '\0';
-    // Set r to the address where to store the line to scan
-    char *r = repl_buf + strlen(repl_buf);
+    size_t len = 0;
     for (;;) {
         if (prompt)
             printf("%s %i%c ", prompt, repl_line, c);
-        r = fgets(r, repl_BUFSIZ - (r - repl_buf), in);
-        if (r == NULL) return r;
-        if (r - repl_buf >= repl_BUFSIZ - 2) {
-            fputs("Line too long!\n", stderr);
-            return r;
-        }
-        if ((p = strrchr(r, '\\')) == NULL) return r;
+        // Read a whole line, however long, from the len-th byte
+        size_t start = len;
+        do {
+            repl_room(len, BUFSIZ);
+            if (fgets(repl_buf + len, repl_size - len, in) == NULL) {
+                if (len == start) return NULL;
+                break;
+            }
+            len += strlen(repl_buf + len);
+        } while (repl_buf[len - 1] != '\n');
+        char *r = repl_buf + start;
+        if ((p = strrchr(r, '\\')) == NULL) return repl_buf;
         // Strip spaces on the right
         while (p > r && isspace(p[-1]))
             -- p;
         *p = ' ';   // transforms the backslash into a space
+        p[1] = '\0';
+        len = p + 1 - repl_buf;
+        ++ repl_line;
+        c = '|';
+    }
+}
+
+/** Gets a line from the text *r_text, which is changed in place:
+    the line is terminated by '\0' and *r_text is set to the
+    following one. Lines ending with a backslash are joined as
+    done by repl_fget(), which also prints the prompt. The address
+    of the line is returned, or NULL at the end of the text. */
+static char *repl_tget(char **r_text, const char *prompt)
+{
+    char *line = *r_text;
+    char c = ':';       // becomes '|' in multiple lines
+    if (*line == '\0') return NULL;
+    for (char *text = line; ; text = text + 1) {
+        if (prompt)
+            printf("%s %i%c ", prompt, repl_line, c);
+        char *eol = strchr(text, '\n');
+        if (eol == NULL) eol = text + strlen(text);
+        // Look for the last backslash before the end of line
+        char *p = eol;
+        while (p > text && p[-1] != '\\')
+            -- p;
+        // Ignore anything from the backslash up to the end of line
+        if (p > text) memset(p - 1, ' ', eol - p + 1);
+        if (p == text || *eol == '\0') {
+            *r_text = (*eol == '\0') ? eol : eol + 1;
+            *eol = '\0';
+            return line;
+        }
         ++ repl_line;
-        r = p + 1;
         c = '|';
+        text = eol;
     }
 }
 
+/** Gets a line from the source src as repl_fget() does: from
+    a text in memory the line is returned in place. */
+static char *repl_get(repl_src_t src, const char *prompt)
+{
+    return (src->in != NULL) ? repl_fget(src->in, prompt)
+        : repl_tget(&src->text, prompt);
+}
+
 // Forward declaration
-static void repl(FILE *in, char *prompt);
+static void repl(repl_src_t src, char *prompt);
 
 /** Apply the eval evaluator to the lines of a text file
     whose name is at s. */
@@ -74,11 +146,18 @@ static void repl_batch(char *s)
     FILE *f = fopen(name, "r");
     if (f == NULL) perror(name);
     else {
-        int saved = repl_line;
-        repl_line = 0;
-        repl(f, name);
+        size_t size;
+        struct repl_src_s src = {NULL, str_map(f, &size)};
         fclose(f);
-        repl_line = saved;
+        if (src.text == NULL) perror(name);
+        else {
+            char *text = src.text;
+            int saved = repl_line;
+            repl_line = 0;
+            repl(&src, name);
+            repl_line = saved;
+            str_unmap(text, size);
+        }
     }
     free(name);
 }
@@ -96,17 +175,34 @@ static void repl_help(void)
     "   'batch FILENAME': the FILENAME text file is opened for\n"
     "      reading and each line of it is evaluated as a single\n"
     "      line typed in the interactive mode.\n"
+    "   'budget KBYTES': set the memory available to the stacks\n"
+    "      of the SECD machine, thus the depth of nested calls.\n"
     "   'bye' ends the session and closes the interpreter.\n"
+    "   'cache': print how many Niceful lines have been found\n"
+    "      already translated, and the memory used to store them.\n"
+    "   'cache KBYTES': set the memory available to store Niceful\n"
+    "      lines translated, reused if they are evaluated again.\n"
+    "   'engine secd': evaluate Awful code by compiling it for\n"
+    "      the SECD machine (default).\n"
+    "   'engine eval': evaluate Awful code by interpreting tokens.\n"
     "   'help' prints this message.\n"
+    "   'load FILENAME': forget all definitions bound by preludes\n"
+    "      and bind the ones saved into FILENAME by 'save'.\n"
     "   'niceful': switch to Niceful interpreter.\n"
+    "   'nursery KBYTES': set the size of the memory where new\n"
+    "      values are created before being collected.\n"
     "   'output': redirect output to terminal screen.\n"
     "   'output FILENAME': redirect output to file FILENAME (in"
     "      append mode).\n"
-    "   'prelude FILENAME ...' the FILENAME text file is opened for\n"
-    "      reading and its lines are joined in a single line to\n"
-    "      which the next input line is appended: the resulting\n"
-    "      string is evaluated.\n"
-    "Warning: a preluded file cannot exceed 64Kbytes.\n" 
+    "   'prelude FILENAME ...': each FILENAME text file contains a\n"
+    "      let or letrec expression, whose definitions are bound\n"
+    "      once for all next expressions (the expression after the\n"
+    "      last 'in' is ignored): the names bound are printed.\n"
+    "   'prelude': forget all definitions bound by preludes.\n"
+    "   'save FILENAME': save into FILENAME an image of all\n"
+    "      definitions bound by preludes, which 'load' binds\n"
+    "      faster than loading the preludes again.\n"
+    "   'status': print memory usage and collector statistics.\n"
     , repl_out);
 }
 
@@ -129,33 +225,99 @@ static void repl_output(char *s)
     }
 }
 
-/** Read the file whose name is at filename in repl_buf and
-    append to it a line from the in file: next evaluate
-    the result and print the result on repl_out. */
-static void repl_prelude(char *filename, FILE *in, char *prompt)
+/** Select the engine used by awful() to evaluate expressions
+    by its name at s. */
+static void repl_engine(char *s)
 {
-    filename = str_strip(filename);
-    char *name = malloc(strlen(filename) + 1);
-    assert(name || !"Malloc error (this is weird)");
-    strcpy(name, filename);
-    
-    FILE *f = fopen(name, "r");
-    if (f == NULL) perror(name);
+    s = str_strip(s);
+    if (strcmp(s, "secd") == 0) awful_engine = AWFUL_SECD;
+    else if (strcmp(s, "eval") == 0) awful_engine = AWFUL_EVAL;
+    else fprintf(stderr, "Unknown engine '%s'\n", s);
+}
+
+/** Return the positive number of Kbytes at s, converted into
+    bytes, or 0 if s does not contain such a number. */
+static size_t repl_kbytes(char *s)
+{
+    char *end;
+    long kb = strtol(s, &end, 10);
+    if (kb <= 0 || *str_strip(end) != '\0') {
+        fprintf(stderr, "Positive number of Kbytes expected\n");
+        return 0;
+    }
+    return (size_t)kb << 10;
+}
+
+/** Set the memory budget of the SECD machine to the number
+    of Kbytes at s. */
+static void repl_budget(char *s)
+{
+    size_t bytes = repl_kbytes(s);
+    if (bytes > 0) secd_budget = bytes;
+}
+
+/** Set the memory available to the translation cache to the
+    number of Kbytes at s, or print its statistics if s is empty:
+    if the number is 0 then nothing is cached. */
+static void repl_cache(char *s)
+{
+    s = str_strip(s);
+    if (*s == '\0') cache_status(repl_out);
+    else if (strcmp(s, "0") == 0) cache_set_budget(0);
     else {
-        unsigned len = fread(repl_buf, 1, repl_BUFSIZ, f);
+        size_t bytes = repl_kbytes(s);
+        if (bytes > 0) cache_set_budget(bytes);
+    }
+}
+
+/** Set the size of the nursery of the collector to the number
+    of Kbytes at s. */
+static void repl_nursery(char *s)
+{
+    size_t bytes = repl_kbytes(s);
+    if (bytes > 0) stack_set_nursery(bytes);
+}
+
+/** Load the preludes whose file names are at s, separated by
+    spaces, binding the names they define in the environment of
+    next expressions: if there are no names, all bindings made
+    by previous preludes are forgotten. */
+static void repl_prelude(char *s)
+{
+    s = str_strip(s);
+    if (*s == '\0') {
+        awful_prelude_drop();
+        return;
+    }
+    while (*s != '\0') {
+        char *name = s;
+        s += strcspn(s, " \t");
+        if (*s != '\0') *s++ = '\0';
+        s += strspn(s, " \t");
+        FILE *f = fopen(name, "r");
+        if (f == NULL) {
+            perror(name);
+            continue;
+        }
+        size_t size;
+        char *text = str_map(f, &size);
         fclose(f);
-        if (len >= repl_BUFSIZ - 2) {
-            fprintf(stderr, "Prelude %s too long (max %u bytes)",
-                name, repl_BUFSIZ);
-        } else {
-            repl_buf[len] = ' ';
-            repl_buf[len + 1] = '\0';
-            if (repl_get(in, prompt, 1) && *repl_buf != '\0'
-            && repl_eval(repl_buf, repl_out))
-                printf(": line %i\n", repl_line);
+        if (text == NULL) perror(name);
+        else {
+            if (repl_define(text, repl_out))
+                printf(": file %s\n", name);
+            str_unmap(text, size);
         }
     }
-    free(name);
+}
+
+/** Save into the file whose name is at s, or load from it, an
+    image of the definitions bound by preludes. */
+static void repl_image(char *s, int (*image_f)(char*))
+{
+    s = str_strip(s);
+    if (*s == '\0') fprintf(stderr, "File name expected\n");
+    else if (image_f(s)) printf(": file %s\n", s);
 }
 
 /** Scan from file in a line of text (possibly asking for more
@@ -163,30 +325,49 @@ static void repl_prelude(char *filename, FILE *in, char *prompt)
     interpret function and print on the out file the result.
     If prompt is not NULL it is printed on out before reading
     a line from in. */
-static void repl(FILE *in, char *prompt)
+static void repl(repl_src_t src, char *prompt)
 {
     int n;
     char *p;
-    for (repl_line = 1; repl_get(in, prompt, 0); ++ repl_line) {
-        char *text = str_strip(repl_buf);
+    char *line;
+    for (repl_line = 1; (line = repl_get(src, prompt)) != NULL; ++ repl_line) {
+        char *text = str_strip(line);
         if (strcmp(text, "awful") == 0) {
             fputs("Awful interpreter\n", stderr);
             prompt = "awful";
             repl_eval = awful;
+            repl_define = awful_prelude;
         } else if (memcmp(text, "batch ", 6) == 0) {
             repl_batch(text + 6);
+        } else if (memcmp(text, "budget ", 7) == 0) {
+            repl_budget(text + 7);
         } else if (strcmp(text, "bye") == 0) {
             break;
+        } else if (strcmp(text, "cache") == 0
+        || memcmp(text, "cache ", 6) == 0) {
+            repl_cache(text + 5);
+        } else if (memcmp(text, "engine ", 7) == 0) {
+            repl_engine(text + 7);
         } else if (strcmp(text, "help") == 0) {
             repl_help();
+        } else if (memcmp(text, "load ", 5) == 0) {
+            repl_image(text + 5, image_load);
         } else if (strcmp(text, "niceful") == 0) {
             fputs("Niceful interpreter\n", stderr);
             prompt = "niceful";
             repl_eval = nice;
+            repl_define = nice_prelude;
+        } else if (memcmp(text, "nursery ", 8) == 0) {
+            repl_nursery(text + 8);
         } else if (memcmp(text, "output", 6) == 0) {
             repl_output(text + 6);
-        } else if (memcmp(text, "prelude ", 8) == 0) {
-            repl_prelude(text + 8, in, prompt);
+        } else if (memcmp(text, "prelude", 7) == 0) {
+            repl_prelude(text + 7);
+        } else if (memcmp(text, "save ", 5) == 0) {
+            repl_image(text + 5, image_save);
+        } else if (strcmp(text, "status") == 0) {
+            stack_status(repl_out);
+            str_status(repl_out);
         } else {
             if (*text != '\0' && repl_eval(text, repl_out))
                printf(": line %i\n", repl_line);
@@ -202,7 +383,8 @@ int main(int argc, char **argv)
         "[v." VERSION ". Type 'help' for... guess what?]\n"
     );
     repl_out = stdout;  // cannot initialize at global scope
-    repl(stdin, "niceful");
+    struct repl_src_s src = {stdin, NULL};
+    repl(&src, "niceful");
     puts("Goodbye");
     return 0;
 }
@@ -1,7 +1,6 @@
 /** scan.c */
 
 #include <assert.h>
-#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include "../header/awful_key.h"
@@ -11,55 +10,235 @@
 #include "../header/str.h"
 #include "../header/val.h"
 
+/** Let each '(' and '{' token in the list point to the matching
+    ')' or '}' token: while scanning, the value of an open token
+    is used to link it to the enclosing open token, if any. */
+static stack_t scan_match(stack_t tokens)
+{
+    stack_t open = NULL;    // innermost open token
+    for (stack_t t = tokens; t != NULL; t = t->next) {
+        int type = val_type(t->val);
+        if (type == '(' || type == '{') {
+            t->val = val_with_p(t->val, open);
+            open = t;
+        } else if (open != NULL && ((type == ')' && val_type(open->val) == '(')
+        || (type == '}' && val_type(open->val) == '{'))) {
+            stack_t enclosing = val_s(open->val);
+            open->val = val_with_p(open->val, t);
+            open = enclosing;
+        }
+    }
+    // Unmatched open tokens point to nothing
+    while (open != NULL) {
+        stack_t enclosing = val_s(open->val);
+        open->val = val_with_p(open->val, NULL);
+        open = enclosing;
+    }
+    return tokens;
+}
+
+/** Classes of characters: each token starts with a character
+    which is not SCAN_SPACE and an atom ends with a character
+    which is not SCAN_ATOM. */
+enum { SCAN_ATOM, SCAN_SPACE, SCAN_DELIM, SCAN_QUOTE, SCAN_END };
+
+/** Class of each character w.r.t. the delimiters scan_delims. */
+static unsigned char scan_class[256];
+
+/** Delimiters used to compute scan_class, if any. */
+static char *scan_delims = NULL;
+
+/** Compute scan_class for the delimiters in delims, unless
+    they are the same of the last call. */
+static void scan_classify(char *delims)
+{
+    if (delims == scan_delims) return;
+    memset(scan_class, SCAN_ATOM, sizeof(scan_class));
+    for (char *s = " \t\n\v\f\r"; *s != '\0'; ++ s)
+        scan_class[(unsigned char) *s] = SCAN_SPACE;
+    for (char *s = delims; *s != '\0'; ++ s)
+        scan_class[(unsigned char) *s] = SCAN_DELIM;
+    scan_class['\''] = scan_class['"'] = SCAN_QUOTE;
+    scan_class['\0'] = SCAN_END;
+    scan_delims = delims;
+}
+
+/** Powers of 10 which are exactly represented as double. */
+static const double scan_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/** If the n characters at p are a number, as read by strtod(),
+    store its value at *r_n and return 1, else return 0. Decimal
+    numbers with at most 15 digits and a small exponent, thus the
+    usual ones, are computed without calling strtod(). */
+static int scan_number(char *p, unsigned n, double *r_n)
+{
+    char *q = p, *end = p + n;
+    int neg = (*q == '-');
+    if (*q == '-' || *q == '+') ++ q;
+    unsigned long long m = 0;   // digits, as an integer
+    int digits = 0;             // number of digits in m
+    int e = 0;                  // decimal exponent
+    for (; q < end && *q >= '0' && *q <= '9'; ++ q, ++ digits)
+        m = 10 * m + (*q - '0');
+    if (q < end && *q == '.')
+        for (++ q; q < end && *q >= '0' && *q <= '9'; ++ q, ++ digits, -- e)
+            m = 10 * m + (*q - '0');
+    if (digits > 0 && q < end && (*q == 'e' || *q == 'E')) {
+        char *r = q + 1;
+        int eneg = (r < end && *r == '-');
+        if (r < end && (*r == '-' || *r == '+')) ++ r;
+        int x = 0;
+        for (q = r; q < end && *q >= '0' && *q <= '9' && x < 1000; ++ q)
+            x = 10 * x + (*q - '0');
+        if (q == r) q = end + 1;    // no digits: leave it to strtod
+        e += eneg ? -x : x;
+    }
+    if (q == end && digits > 0 && digits <= 15 && e >= -22 && e <= 22) {
+        // Both m and 10^|e| are exact, so the result is rounded once
+        double d = (e < 0) ? m / scan_pow10[-e] : m * scan_pow10[e];
+        *r_n = neg ? -d : d;
+        return 1;
+    }
+    // Leave other numbers, hexadecimals, inf and nan to strtod
+    q = p + (*p == '-' || *p == '+');
+    if (strchr(".0123456789iInN", *q) == NULL) return 0;
+    *r_n = strtod(p, &q);
+    return q == end;
+}
+
+/** Values of the tokens found by scan() so far: scan_n are used
+    and there is room for scan_size of them. */
+static val_t *scan_vals = NULL;
+static unsigned scan_n = 0, scan_size = 0;
+
+/** Append the value of a token to scan_vals. */
+static void scan_put(val_t v)
+{
+    if (scan_n == scan_size) {
+        scan_size = (scan_size == 0) ? 1024 : 2 * scan_size;
+        val_t *vals = realloc(scan_vals, scan_size * sizeof(val_t));
+        except_on(vals == NULL, "Fatal allocation error"
+            " @%s:%i", __FILE__, __LINE__);
+        scan_vals = vals;
+    }
+    scan_vals[scan_n ++] = v;
+}
+
+/** Return the list of the tokens found by scan(): their items
+    are consecutive, so that they are visited in the order they
+    are stored in memory. */
+static stack_t scan_list(void)
+{
+    stack_t tokens = stack_new_list(scan_n);
+    for (unsigned i = 0; i < scan_n; ++ i)
+        tokens[i].val = scan_vals[i];
+    return scan_match(tokens);
+}
+
 stack_t scan(char *text, char *delims, void *key_find(char*,unsigned))
 {
     val_t v;
-    stack_t tokens = NULL;
-    while (*text != '\0') {
-        text += strspn(text, " \t\n\r");    // skip spaces
-        if (*text == '\0') break;
-        if (*text == '\\') {    // Skip until the end of the line
-            if ((text = strchr(text + 1, '\n')) == NULL) break;
-            continue;
-        }
-        if (strchr(delims, *text) != NULL) {
-            v.type = *text;
-            tokens = stack_push(tokens, v);
+    scan_n = 0;
+    scan_classify(delims);
+    for (;;) {
+        while (scan_class[(unsigned char) *text] == SCAN_SPACE)
             ++ text;
-        } else
-        if (*text == '\'' || *text == '"') {
+        switch (scan_class[(unsigned char) *text]) {
+        case SCAN_END:
+            return scan_list();
+        case SCAN_DELIM:
+            v = val_make(*text++, NULL);
+            break;
+        case SCAN_QUOTE: {
             char q = *text;
             char *p = strchr(text + 1, q);
             except_on(p == NULL, "End of text inside string");
-            v.type = STRING;
-            v.val.t = str_new(text + 1, p - text - 1);
-            tokens = stack_push(tokens, v);
+            v = val_make(STRING, str_new(text + 1, p - text - 1));
             text = p + 1;
-        } else {
-            // Scans up to the following space or delimiter.
+            break;
+        }
+        default:
+            if (*text == '\\') {    // Skip until the end of the line
+                if ((text = strchr(text + 1, '\n')) == NULL)
+                    return scan_list();
+                continue;
+            }
+            // Scans up to the following space, delimiter or quote.
             char *p = text++;
-            while (*text != '\0' && !isspace(*text)
-            && strchr(delims, *text) == NULL && *text != '\''
-            && *text != '"')
+            while (scan_class[(unsigned char) *text] == SCAN_ATOM)
                 ++ text;
             // The atom starts at p and its length is text - p.
-            // Check against a number.
-            char *q;
-            v.val.n = strtod(p, &q);
-            if (q == text) {
-                v.type = NUMBER;
+            double n;
+            if (scan_number(p, text - p, &n)) {
+                v = val_number(n);
             } else {
                 void *k = key_find(p, text - p);
                 if (k != NULL) {
-                    v.type = KEYWORD;
-                    v.val.p = k;
+                    v = val_make(KEYWORD, k);
                 } else {
-                    v.type = ATOM;
-                    v.val.t = str_new(p, text - p);
+                    v = val_make(ATOM, str_new(p, text - p));
                 }
             }
-            tokens = stack_push(tokens, v);
         }
+        scan_put(v);
     }
-    return stack_reverse(tokens);
+}
+
+stack_t scan_copy(stack_t tokens)
+{
+    scan_n = 0;
+    for (; tokens != NULL; tokens = tokens->next)
+        scan_put(tokens->val);
+    return scan_list();
+}
+
+stack_t scan_restore(const val_t *vals, unsigned n)
+{
+    stack_t tokens = stack_new_list(n);
+    for (unsigned i = 0; i < n; ++ i)
+        tokens[i].val = vals[i];
+    return scan_match(tokens);
+}
+
+/** Return the position of the n characters at t in a
+    scan_keys_t table whose hash uses the multiplier seed. */
+static unsigned scan_keys_hash(unsigned seed, const char *t, unsigned n)
+{
+    unsigned h = n;
+    while (n-- > 0)
+        h = h * seed + (unsigned char) *t++;
+    return (h * 2654435769u) >> 25;     // 7 bits, since SCAN_KEYS is 128
+}
+
+void scan_keys(scan_keys_t k, unsigned n, char **names, void **keys)
+{
+    except_on(n >= SCAN_KEYS, "BUG: %s:%i", __FILE__, __LINE__);
+    k->maxlen = 0;
+    for (unsigned i = 0; i < n; ++ i)
+        if (strlen(names[i]) > k->maxlen) k->maxlen = strlen(names[i]);
+    // Try multipliers until the hash has no collisions
+    for (k->seed = 1; ; k->seed += 2) {
+        except_on(k->seed == 0, "BUG: %s:%i", __FILE__, __LINE__);
+        memset(k->name, 0, sizeof(k->name));
+        unsigned i;
+        for (i = 0; i < n; ++ i) {
+            unsigned h = scan_keys_hash(k->seed, names[i], strlen(names[i]));
+            if (k->name[h] != NULL) break;
+            k->name[h] = names[i];
+            k->key[h] = keys[i];
+        }
+        if (i == n) return;
+    }
+}
+
+void *scan_keys_find(scan_keys_t k, char *t, unsigned n)
+{
+    if (n > k->maxlen) return NULL;
+    unsigned h = scan_keys_hash(k->seed, t, n);
+    char *name = k->name[h];
+    return name != NULL && strncmp(name, t, n) == 0 && name[n] == '\0'
+        ? k->key[h] : NULL;
 }
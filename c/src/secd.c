@@ -0,0 +1,1102 @@
+/** \file secd.c */
+
+/** This module compiles Awful token lists into code for a SECD
+    machine, loosely following python/secd.py, and executes it:
+    a closure body is scanned once, when compiled, and not each
+    time the closure is applied.
+
+    The machine registers are:
+
+    - S, the stack of values being computed;
+    - E, the environment: a chain of frames, each frame being a
+        vector created by stack_new_vec() whose next item is the
+        enclosing frame;
+    - C, the instruction to execute, inside a code prototype;
+    - D, the dump, a stack of (C,E) pairs saved by calls.
+
+    S and D are arrays enlarged when needed, up to secd_budget
+    bytes: the depth of non tail calls is limited only by it.
+
+    When a call is executed, if enough stack items have been
+    allocated, those which cannot be reached from the registers
+    or from the compiled code are collected.
+
+    A closure is a value {type:CLOSURE, val:c} where c is a stack
+    item whose value is {type:CODE, val:p}, p being the prototype
+    of its body, and whose next item is the environment in which
+    the closure has been created.
+
+    Variables are resolved when compiled: an atom becomes the
+    address (depth,index) of its value, depth being the number of
+    frames to go up from the top of E and index the position of
+    the value inside that frame. A closure with no parameters
+    creates no frame.
+
+    A call whose value is returned as it is by the closure, thus
+    a call in tail position, reuses the dump entry of the closure,
+    so that tail recursive functions use constant space in D.
+
+    The application of a closure literal, as the ones produced
+    by Niceful let and letrec, is compiled inline: formal
+    parameters marked by '!' are bound after all parameters
+    not so marked, as done by awful_eval. If the function is not
+    a closure literal then all its actual parameters are
+    evaluated before binding them.
+
+    The keywords MAP, FILTER, FOLD and SORTBY, which apply a
+    closure to the items of a stack, are compiled as loops whose
+    state is kept on S and which call the closure by CALL: they
+    use no space in D. MAP and FILTER build their result by
+    appending items to it, SORTBY merges runs of items between
+    two vectors.
+
+    The frames bound by preludes form the top level environment,
+    which secd_run() puts in E when it starts: secd_bind() copies
+    them, and the code of their closures, into permanent memory.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "../header/awful_key.h"
+#include "../header/except.h"
+#include "../header/image.h"
+#include "../header/secd.h"
+#include "../header/stack.h"
+#include "../header/val.h"
+
+/** Opcodes of the SECD machine: comments show the effect of
+    each instruction on S; a and b are its operands, k is the
+    constants table of the prototype. */
+enum {
+    STOP,   // v ->         return v from secd_run()
+    LDC,    // -> k[b]      push a constant
+    LD,     // -> v         push the b-th value of the a-th frame of E
+    LDF,    // -> f         push a closure of prototype k[b]
+    PRIM,   // x1...xa -> v apply the keyword k[b] of arity a
+    SEL,    // n ->         jump to b if n is zero
+    JMP,    // ->           jump to b
+    CALL,   // f x1...xa -> v   apply f to a values
+    TAILCALL,   // f x1...xa -> v   apply f to a values, then return
+    RTN,    // v -> v       return to the caller
+    ENTER,  // x1...xb ->   push on E a frame of a values (b = 0 or a)
+    STORE,  // v ->         store v as the b-th value of E's top frame
+    LEAVE,  // ->           drop the frame on top of E
+    LOOP,   // f x -> l     start a loop of kind a
+    NEXT,   // l -> l f [z] y   apply f to the next item y, or jump to b
+    COLLECT,    // l v -> l     put v into the result of the loop
+};
+
+/** Kinds of the loops compiled for the keywords which apply a
+    closure to the items of a stack. The state l of a loop is on
+    S: the closure f, the items r still to visit and, for FILTER
+    and MAP, the result h and its last item t, else the partial
+    result z of FOLD. FILTER keeps on S the item y too. The state
+    of SORTBY is described by secd_merge(). */
+enum { FILTER_LOOP, FOLD_LOOP, MAP_LOOP, SORTBY_LOOP };
+
+static struct {
+    char *name;     ///< keyword compiled as the loop
+    char *error;    ///< message if r is not a stack
+    int size;       ///< number of values of l on S
+} secd_loops[] = {
+    {"FILTER", "FILTER f x needs x to be a stack", 5},
+    {"FOLD", "FOLD f z x needs x to be a stack", 3},
+    {"MAP", "MAP f x needs x to be a stack", 4},
+    {"SORTBY", "SORTBY f x needs x to be a stack", 8},
+};
+
+/// Number of kinds of loops
+#define SECD_LOOPS (sizeof(secd_loops) / sizeof(*secd_loops))
+
+/** A single instruction. */
+typedef struct secd_ins_s {
+    short op;   ///< opcode
+    short a;    ///< arity or number of values
+    int b;      ///< constant index, jump target or frame slot
+} secd_ins_t;
+
+struct secd_proto_s {
+    struct secd_proto_s *next;  ///< next item in secd_protos
+    secd_ins_t *ins;            ///< instructions
+    unsigned n, size;           ///< # of instructions, room for them
+    val_t *k;                   ///< constants
+    unsigned nk, ksize;         ///< # of constants, room for them
+    stack_t params;             ///< [mode,name,...] as in awful_eval
+    stack_t body, end;          ///< body tokens and '}', for printing
+    int nparams;                ///< number of formal parameters
+    int depth;                  ///< depth of S while compiling
+    int maxdepth;               ///< max depth of S during execution
+    unsigned index;             ///< position among the kept ones
+};
+
+/** Compile-time image of a frame of E: the formal parameters
+    whose values are stored in the frame, and the scope of the
+    enclosing frame, NULL at top level. */
+typedef struct secd_scope_s {
+    stack_t params;             ///< [mode,name,...]
+    struct secd_scope_s *up;    ///< enclosing scope
+} *secd_scope_t;
+
+/** List of all prototypes compiled so far. */
+static secd_proto_t secd_protos = NULL;
+
+/** List of the prototypes kept by secd_bind(), which are not
+    deleted by secd_reset(). */
+static secd_proto_t secd_kept = NULL;
+
+/** Number of kept prototypes, and those loaded by secd_load()
+    sorted by index. */
+static unsigned secd_nkept = 0;
+static secd_proto_t *secd_loaded = NULL;
+
+/** Compile-time image of the top level environment, and the
+    environment itself, both set by secd_bind(). */
+static secd_scope_t secd_top = NULL;
+static stack_t secd_top_env = NULL;
+
+size_t secd_budget = SECD_BUDGET;
+
+/** The S register points inside this array, which is enlarged
+    when needed: secd_s_end is the address following it. */
+static val_t *secd_s = NULL, *secd_s_end = NULL;
+
+/** The D register points inside this array, which is enlarged
+    when needed: secd_d_end is the address following it. */
+static struct secd_dump_s {
+    secd_proto_t p;     ///< prototype of the caller
+    secd_ins_t *pc;     ///< instruction to resume
+    stack_t e;          ///< environment of the caller
+} *secd_d = NULL, *secd_d_end = NULL;
+
+/** Allocate a new empty prototype and return it. */
+static secd_proto_t secd_proto_new(void)
+{
+    secd_proto_t p = calloc(1, sizeof(struct secd_proto_s));
+    except_on(p == NULL, "Fatal allocation error"
+        " @%s:%i", __FILE__, __LINE__);
+    p->next = secd_protos;
+    return secd_protos = p;
+}
+
+/** Append an instruction to p and return its index: delta is
+    the change of the depth of S caused by the instruction. */
+static unsigned secd_emit(secd_proto_t p, int op, int a, int b, int delta)
+{
+    if (p->n == p->size) {
+        p->size = (p->size == 0) ? 16 : 2 * p->size;
+        secd_ins_t *ins = realloc(p->ins, p->size * sizeof(secd_ins_t));
+        except_on(ins == NULL, "Fatal allocation error"
+            " @%s:%i", __FILE__, __LINE__);
+        p->ins = ins;
+    }
+    secd_ins_t *i = p->ins + p->n;
+    i->op = op;
+    i->a = a;
+    i->b = b;
+    p->depth += delta;
+    if (p->depth > p->maxdepth) p->maxdepth = p->depth;
+    return p->n ++;
+}
+
+/** Append a constant to p and return its index. */
+static int secd_const(secd_proto_t p, val_t v)
+{
+    if (p->nk == p->ksize) {
+        p->ksize = (p->ksize == 0) ? 8 : 2 * p->ksize;
+        val_t *k = realloc(p->k, p->ksize * sizeof(val_t));
+        except_on(k == NULL, "Fatal allocation error"
+            " @%s:%i", __FILE__, __LINE__);
+        p->k = k;
+    }
+    p->k[p->nk] = v;
+    return p->nk ++;
+}
+
+/** Raise an error with message msg if tokens does not start
+    with the delimiter d, else return tokens deprived of d. */
+static stack_t secd_expect(stack_t tokens, int d, char *msg)
+{
+    except_on(tokens == NULL || val_type(tokens->val) != d, msg);
+    return tokens->next;
+}
+
+/** Return the tokens following the expression on top of
+    tokens, without compiling it. */
+static stack_t secd_skip(stack_t tokens)
+{
+    for (;;) {
+        except_on(tokens == NULL, "Expression expected");
+        int type = val_type(tokens->val);
+        if (type == KEYWORD) {
+            int n = ((awful_key_t) val_p(tokens->val))->arity;
+            tokens = tokens->next;
+            if (n == 0) return tokens;
+            while (--n > 0)
+                tokens = secd_skip(tokens);
+            // The last parameter is skipped by the loop
+        } else if (type == '{' || type == '(') {
+            // Skip up to the matching '}' or ')' found by scan()
+            except_on(val_s(tokens->val) == NULL, "Unexpected end of text");
+            return val_s(tokens->val)->next;
+        } else {
+            return tokens->next;
+        }
+    }
+}
+
+/** Parse the formal parameters of a closure up to the ':'
+    (which is skipped too) and return them as a stack of the
+    form [mode,name,...], mode being NONE or '!', as done by
+    awful_eval. The number of parameters is stored at *r_n. */
+static stack_t secd_params(stack_t *r_tokens, int *r_n)
+{
+    stack_t tokens = *r_tokens;
+    stack_t params = NULL;
+    int n = 0;
+    except_on(tokens == NULL, "Closure expected");
+    while (val_type(tokens->val) != ':') {
+        val_t v = VAL_NONE;
+        if (val_type(tokens->val) == '!') {
+            v = val_make('!', NULL);
+            tokens = tokens->next;
+        }
+        except_on(tokens == NULL || val_type(tokens->val) != ATOM,
+            "Atom expected as closure formal parameter");
+        params = stack_push(params, v);
+        params = stack_push(params, tokens->val);
+        tokens = tokens->next;
+        except_on(tokens == NULL, "':' expected in closure");
+        ++ n;
+    }
+    *r_tokens = tokens->next;   // skip ':'
+    *r_n = n;
+    return stack_reverse(params);
+}
+
+/** Compile the atom t, looking for it inside the scope sc:
+    the last formal parameter with a given name hides the former
+    ones, as done by awful_eval. */
+static void secd_ld(secd_proto_t p, secd_scope_t sc, char *t)
+{
+    for (int depth = 0; sc != NULL; sc = sc->up, ++ depth) {
+        int index = -1, i = 0;
+        for (stack_t fp = sc->params; fp != NULL; fp = fp->next->next, ++ i)
+            if (strcmp(val_str(fp->next->val), t) == 0)
+                index = i;
+        if (index >= 0) {
+            secd_emit(p, LD, depth, index, 1);
+            return;
+        }
+    }
+    except_on(1, "Undefined variable %s", t);
+}
+
+/** Replace with TAILCALL each CALL of p which is followed by
+    a RTN, possibly through jumps and LEAVEs: the environment
+    restored by RTN makes LEAVE useless. */
+static void secd_tailcalls(secd_proto_t p)
+{
+    for (unsigned j = 0; j < p->n; ++ j) {
+        if (p->ins[j].op != CALL) continue;
+        unsigned k = j + 1;
+        while (p->ins[k].op == JMP || p->ins[k].op == LEAVE)
+            k = (p->ins[k].op == JMP) ? (unsigned) p->ins[k].b : k + 1;
+        if (p->ins[k].op == RTN)
+            p->ins[j].op = TAILCALL;
+    }
+}
+
+// Forward reference
+static void secd_expr(secd_proto_t p, secd_scope_t sc, stack_t *r_tokens);
+
+/** Compile a closure: *r_tokens points to the '{'. */
+static void secd_closure(secd_proto_t p, secd_scope_t sc, stack_t *r_tokens)
+{
+    stack_t tokens = *r_tokens;
+    secd_proto_t q = secd_proto_new();
+    q->end = val_s(tokens->val);    // matching '}'
+    except_on(q->end == NULL, "'}' expected to end closure body");
+    tokens = tokens->next;
+    q->params = secd_params(&tokens, &q->nparams);
+    q->body = tokens;
+    struct secd_scope_s inner = {q->params, sc};
+    secd_expr(q, (q->nparams > 0) ? &inner : sc, &tokens);
+    secd_emit(q, RTN, 0, 0, 0);
+    secd_tailcalls(q);
+    tokens = secd_expect(tokens, '}', "'}' expected to end closure body");
+    secd_emit(p, LDF, 0, secd_const(p, val_make(CODE, q)), 1);
+    *r_tokens = tokens;
+}
+
+/** Compile "({params: body} e1, ..., en)": *r_tokens points
+    to the '{'. The body is compiled inline, inside a new frame
+    pushed on E. */
+static void secd_let(secd_proto_t p, secd_scope_t sc, stack_t *r_tokens)
+{
+    stack_t tokens = (*r_tokens)->next;     // skip '{'
+    int n;
+    stack_t params = secd_params(&tokens, &n);
+    stack_t body = tokens;
+    tokens = secd_skip(*r_tokens);          // skip up to '}'
+    struct secd_scope_s inner = {params, sc};
+    if (n == 0) {
+        tokens = secd_expect(tokens, ')', "')' expected after parameterless function");
+    } else {
+        // First compile actual parameters not marked by '!'
+        stack_t args = tokens;
+        int m = 0;
+        for (stack_t fp = params; fp != NULL; fp = fp->next->next) {
+            if (fp->val == VAL_NONE) {
+                secd_expr(p, sc, &tokens);
+                ++ m;
+            } else {
+                tokens = secd_skip(tokens);
+            }
+            tokens = (fp->next->next == NULL)
+                ? secd_expect(tokens, ')', "')' expected after actual parameters")
+                : secd_expect(tokens, ',', "',' expected between actual parameters");
+        }
+        if (m == n) {
+            secd_emit(p, ENTER, n, m, -m);
+        } else {
+            // Values on S are moved into an empty frame: the last
+            // one is on top of S.
+            int slots[n], j = 0, slot = 0;
+            for (stack_t fp = params; fp != NULL; fp = fp->next->next, ++ slot)
+                if (fp->val == VAL_NONE)
+                    slots[j++] = slot;
+            secd_emit(p, ENTER, n, 0, 0);
+            while (j > 0)
+                secd_emit(p, STORE, 0, slots[--j], -1);
+        }
+        // Next compile the other ones inside the new frame
+        int slot = 0;
+        for (stack_t fp = params; fp != NULL; fp = fp->next->next, ++ slot) {
+            if (fp->val == VAL_NONE) {
+                args = secd_skip(args);
+            } else {
+                secd_expr(p, &inner, &args);
+                secd_emit(p, STORE, 0, slot, -1);
+            }
+            args = args->next;  // skip ',' or ')'
+        }
+    }
+    secd_expr(p, (n > 0) ? &inner : sc, &body);
+    secd_expect(body, '}', "'}' expected to end closure body");
+    if (n > 0) secd_emit(p, LEAVE, 0, 0, 0);
+    *r_tokens = tokens;
+}
+
+/** Return 1 if tokens starts with "COND e {:e1} {:e2})",
+    thus with the translation of a Niceful conditional. */
+static int secd_is_cond(stack_t tokens)
+{
+    static void *cond = NULL;
+    if (cond == NULL) cond = awful_key_find("COND", 4);
+    if (val_type(tokens->val) != KEYWORD || val_p(tokens->val) != cond)
+        return 0;
+    tokens = secd_skip(tokens->next);
+    for (int i = 0; i < 2; ++ i) {
+        if (tokens == NULL || val_type(tokens->val) != '{'
+        || tokens->next == NULL || val_type(tokens->next->val) != ':')
+            return 0;
+        tokens = secd_skip(tokens);
+    }
+    return tokens != NULL && val_type(tokens->val) == ')';
+}
+
+/** Compile "COND e {:e1} {:e2})" as a conditional jump:
+    *r_tokens points to COND. */
+static void secd_cond(secd_proto_t p, secd_scope_t sc, stack_t *r_tokens)
+{
+    stack_t tokens = (*r_tokens)->next;     // skip COND
+    secd_expr(p, sc, &tokens);
+    unsigned sel = secd_emit(p, SEL, 0, 0, -1);
+    tokens = tokens->next->next;            // skip "{:"
+    secd_expr(p, sc, &tokens);
+    tokens = secd_expect(tokens, '}', "'}' expected to end closure body");
+    // The else branch starts with the same depth of S
+    unsigned jmp = secd_emit(p, JMP, 0, 0, -1);
+    p->ins[sel].b = p->n;
+    tokens = tokens->next->next;            // skip "{:"
+    secd_expr(p, sc, &tokens);
+    tokens = secd_expect(tokens, '}', "'}' expected to end closure body");
+    p->ins[jmp].b = p->n;
+    *r_tokens = secd_expect(tokens, ')', "')' expected");
+}
+
+/** Return the kind of loop compiled for the keyword k, or -1
+    if k is compiled as a PRIM. */
+static int secd_loop_kind(val_t k)
+{
+    static void *keys[SECD_LOOPS] = {NULL};
+    for (unsigned j = 0; j < SECD_LOOPS; ++ j) {
+        if (keys[j] == NULL)
+            keys[j] = awful_key_find(secd_loops[j].name,
+                strlen(secd_loops[j].name));
+        if (val_p(k) == keys[j]) return j;
+    }
+    return -1;
+}
+
+/** Compile a loop of the given kind, whose actual parameters
+    are on S: the closure is applied to each item by CALL, as
+    any other closure, so that no machine is nested into the
+    keyword and the collector finds the state of the loop on S. */
+static void secd_loop(secd_proto_t p, int kind)
+{
+    int n = (kind == FOLD_LOOP || kind == SORTBY_LOOP) ? 2 : 1;
+    int depth = p->depth - ((kind == FOLD_LOOP) ? 2 : 1);
+    if (kind != FOLD_LOOP)
+        secd_emit(p, LOOP, kind, 0, secd_loops[kind].size - 2);
+    unsigned next = secd_emit(p, NEXT, kind, 0, 1 + n);
+    secd_emit(p, CALL, n, 0, -n);
+    secd_emit(p, COLLECT, kind, 0, -1);
+    secd_emit(p, JMP, 0, next, 0);
+    p->ins[next].b = p->n;
+    p->depth = depth;
+}
+
+/** Compile an application: *r_tokens follows the '('. */
+static void secd_application(secd_proto_t p, secd_scope_t sc, stack_t *r_tokens)
+{
+    stack_t tokens = *r_tokens;
+    except_on(tokens == NULL, "Function expected");
+    if (val_type(tokens->val) == '{') {
+        secd_let(p, sc, &tokens);
+    } else if (secd_is_cond(tokens)) {
+        secd_cond(p, sc, &tokens);
+    } else {
+        secd_expr(p, sc, &tokens);  // the function
+        int n = 0;
+        if (tokens != NULL && val_type(tokens->val) == ')') {
+            tokens = tokens->next;
+        } else {
+            for (;;) {
+                secd_expr(p, sc, &tokens);
+                ++ n;
+                except_on(tokens == NULL, "')' expected after actual parameters");
+                int type = val_type(tokens->val);
+                tokens = tokens->next;
+                if (type == ')') break;
+                except_on(type != ',', "')' or ',' expected after actual parameters");
+            }
+        }
+        secd_emit(p, CALL, n, 0, -n);
+    }
+    *r_tokens = tokens;
+}
+
+/** Compile an expression from *r_tokens into p. */
+static void secd_expr(secd_proto_t p, secd_scope_t sc, stack_t *r_tokens)
+{
+    stack_t tokens = *r_tokens;
+    /*  The last parameter of a keyword is compiled by this loop,
+        so that long chains as "PUSH x1 PUSH x2 ... NIL" are not
+        compiled by nested calls: the keywords whose PRIM is still
+        to be emitted are pushed on keys. */
+    stack_t keys = NULL;
+    for (;;) {
+        except_on(tokens == NULL, "Expression expected");
+        val_t v = tokens->val;
+        if (val_type(v) != KEYWORD || ((awful_key_t) val_p(v))->arity == 0)
+            break;
+        tokens = tokens->next;
+        for (int i = 1; i < ((awful_key_t) val_p(v))->arity; ++ i)
+            secd_expr(p, sc, &tokens);
+        keys = stack_push(keys, v);
+    }
+    *r_tokens = tokens;
+    val_t v = tokens->val;
+    tokens = tokens->next;
+    switch (val_type(v)) {
+    case NUMBER:
+    case STRING:
+        secd_emit(p, LDC, 0, secd_const(p, v), 1);
+        break;
+    case ATOM:
+        secd_ld(p, sc, val_str(v));
+        break;
+    case KEYWORD:   // without parameters
+        secd_emit(p, PRIM, 0, secd_const(p, v), 1);
+        break;
+    case '{':
+        tokens = *r_tokens;
+        secd_closure(p, sc, &tokens);
+        break;
+    case '(':
+        secd_application(p, sc, &tokens);
+        break;
+    default:
+        val_fprint(stderr, v);
+        except_on(1, " not expected");
+    }
+    for (; keys != NULL; keys = keys->next) {
+        int n = ((awful_key_t) val_p(keys->val))->arity;
+        int kind = secd_loop_kind(keys->val);
+        if (kind >= 0)
+            secd_loop(p, kind);
+        else
+            secd_emit(p, PRIM, n, secd_const(p, keys->val), 1 - n);
+    }
+    *r_tokens = tokens;
+}
+
+secd_proto_t secd_compile(stack_t tokens)
+{
+    secd_proto_t p = secd_proto_new();
+    p->body = tokens;
+    secd_expr(p, secd_top, &tokens);
+    secd_emit(p, STOP, 0, 0, 0);
+    return p;
+}
+
+void secd_fprint(FILE *f, stack_t c)
+{
+    secd_proto_t p = val_p(c->val);
+    fputc('{', f);
+    // Formal parameters are preceded by their marker ('!' or NONE)
+    for (stack_t fp = p->params; fp != NULL; fp = fp->next) {
+        fputc((val_type(fp->val) == '!') ? '!' : ' ', f);
+        fp = fp->next;
+        fputs(val_str(fp->val), f);
+    }
+    fputc(':', f);
+    // Print the body tokens up to the '}' closing the closure
+    for (stack_t b = p->body; b != p->end; b = b->next) {
+        fputc(' ', f);
+        val_fprint(f, b->val);
+    }
+    fputs("|}", f);
+}
+
+/** Delete all prototypes in the list *r_p. */
+static void secd_free(secd_proto_t *r_p)
+{
+    while (*r_p != NULL) {
+        secd_proto_t next = (*r_p)->next;
+        free((*r_p)->ins);
+        free((*r_p)->k);
+        free(*r_p);
+        *r_p = next;
+    }
+}
+
+void secd_reset(void)
+{
+    secd_free(&secd_protos);
+}
+
+/** Enlarge the array *r_a, whose items are size bytes long,
+    so that it contains at least n items: *r_end is the address
+    following the array. The sizes of S and D cannot exceed
+    secd_budget bytes. */
+static void secd_grow(void **r_a, void **r_end, size_t n, size_t size)
+{
+    size_t old = (char*)*r_end - (char*)*r_a;
+    size_t used = (char*)secd_s_end - (char*)secd_s
+        + (char*)secd_d_end - (char*)secd_d - old;
+    size_t bytes = (old < 4096) ? 4096 : 2 * old;
+    while (bytes < n * size)
+        bytes *= 2;
+    if (used + bytes > secd_budget)
+        bytes = secd_budget - used;
+    except_on(used > secd_budget || bytes < n * size,
+        "Evaluation too nested: SECD budget of %zu bytes exceeded",
+        secd_budget);
+    void *a = realloc(*r_a, bytes);
+    except_on(a == NULL, "Fatal allocation error"
+        " @%s:%i", __FILE__, __LINE__);
+    *r_a = a;
+    *r_end = (char*)a + bytes / size * size;
+}
+
+/** Make room for n values on S, whose register is sp: return
+    the value of sp, which changes if S is moved. */
+static val_t *secd_grow_s(val_t *sp, size_t n)
+{
+    if (sp + n > secd_s_end) {
+        size_t i = sp - secd_s;
+        secd_grow((void**)&secd_s, (void**)&secd_s_end, i + n, sizeof(val_t));
+        sp = secd_s + i;
+    }
+    return sp;
+}
+
+/** Pass to stack_mark() the item *r_s, which is updated. */
+static void secd_mark_s(stack_t *r_s)
+{
+    val_t v = val_make(STACK, *r_s);
+    stack_mark(&v, 1);
+    *r_s = val_s(v);
+}
+
+/** Registers of the SECD machine during a collection. */
+static val_t *secd_gc_sp = NULL;
+static stack_t secd_gc_e = NULL;
+static struct secd_dump_s *secd_gc_dp = NULL;
+
+/** Pass to stack_mark() the values used by the prototypes
+    compiled so far, whose bodies include the whole token list,
+    which are updated. */
+static void secd_mark_protos(void)
+{
+    for (secd_proto_t p = secd_protos; p != NULL; p = p->next) {
+        stack_mark(p->k, p->nk);
+        secd_mark_s(&p->params);
+        secd_mark_s(&p->body);
+        secd_mark_s(&p->end);
+    }
+}
+
+/** Pass to stack_mark() the roots of the SECD machine: the
+    prototypes compiled so far and the registers, which are
+    updated. */
+static void secd_roots(void)
+{
+    secd_mark_protos();
+    stack_mark(secd_s, secd_gc_sp - secd_s);
+    secd_mark_s(&secd_gc_e);
+    for (struct secd_dump_s *d = secd_d; d < secd_gc_dp; ++ d)
+        secd_mark_s(&d->e);
+}
+
+/** Start the merge sort of SORTBY f x, whose state l on S is: f,
+    the vector a to merge runs from, the vector b to merge them
+    into, the length w of the runs, the index lo where the two
+    runs being merged start, the indexes i and j of their next
+    values and the index k of the next value of b, as numbers. */
+static void secd_sort(val_t *l)
+{
+    except_on(val_type(l[1]) != STACK, "%s", secd_loops[SORTBY_LOOP].error);
+    unsigned n = 0;
+    for (stack_t s = val_s(l[1]); s != NULL; s = s->next)
+        ++ n;
+    stack_t a = stack_new_vec(n);
+    val_t *v = stack_vec(a);
+    for (stack_t s = val_s(l[1]); s != NULL; s = s->next)
+        *v++ = s->val;
+    l[1] = val_make(VECTOR, a);
+    // Collections scan every value of b before the merge sets it
+    stack_t b = stack_new_vec(n);
+    v = stack_vec(b);
+    for (unsigned h = 0; h < n; ++ h)
+        v[h] = val_number(0);
+    l[2] = val_make(VECTOR, b);
+    l[3] = val_number(1);
+    l[4] = l[5] = l[7] = val_number(0);
+    l[6] = val_number((n < 1) ? n : 1);
+}
+
+/** Merge the runs of the state l of SORTBY, as described by
+    secd_sort(), until the values a[j] and a[i] are to be
+    compared: then return 1, else 0 once done, the sorted stack
+    being put in l[0]. The values moved were all created before
+    the sort, so that once a collection has made the vectors
+    old it has made the values old too: no store is remembered. */
+static int secd_merge(val_t *l)
+{
+    stack_t a = val_s(l[1]), b = val_s(l[2]);
+    unsigned n = stack_vec_len(a);
+    unsigned w = val_n(l[3]), lo = val_n(l[4]);
+    unsigned i = val_n(l[5]), j = val_n(l[6]), k = val_n(l[7]);
+    for (;;) {
+        unsigned mid = (lo + w < n) ? lo + w : n;
+        unsigned hi = (lo + 2 * w < n) ? lo + 2 * w : n;
+        if (i < mid && j < hi) break;
+        while (i < mid)
+            stack_vec(b)[k++] = stack_vec(a)[i++];
+        while (j < hi)
+            stack_vec(b)[k++] = stack_vec(a)[j++];
+        if ((lo = hi) == n) {
+            // Next pass: runs twice as long are merged back
+            stack_t t = a;
+            a = b;
+            b = t;
+            w *= 2;
+            lo = 0;
+            if (w >= n) {
+                stack_t s = stack_new_list(n);
+                for (unsigned h = 0; h < n; ++ h)
+                    s[h].val = stack_vec(a)[h];
+                l[0] = val_make(STACK, s);
+                return 0;
+            }
+        }
+        i = k = lo;
+        j = (lo + w < n) ? lo + w : n;
+    }
+    l[1] = val_make(VECTOR, a);
+    l[2] = val_make(VECTOR, b);
+    l[3] = val_number(w);
+    l[4] = val_number(lo);
+    l[5] = val_number(i);
+    l[6] = val_number(j);
+    l[7] = val_number(k);
+    return 1;
+}
+
+val_t secd_run(secd_proto_t p)
+{
+    // Release the stacks if the budget has been lowered
+    size_t used = (char*)secd_s_end - (char*)secd_s
+        + (char*)secd_d_end - (char*)secd_d;
+    if (used > secd_budget) {
+        free(secd_s);
+        free(secd_d);
+        secd_s = secd_s_end = NULL;
+        secd_d = secd_d_end = NULL;
+    }
+    val_t *sp = secd_grow_s(secd_s, p->maxdepth);   // S
+    stack_t e = secd_top_env;       // E
+    secd_ins_t *pc = p->ins;        // C
+    struct secd_dump_s *dp = secd_d;    // D
+    for (;;) {
+        secd_ins_t *i = pc++;
+        switch (i->op) {
+        case STOP:
+            return sp[-1];
+        case LDC:
+            *sp++ = p->k[i->b];
+            break;
+        case LD: {
+            stack_t f = e;
+            for (int d = i->a; d > 0; -- d)
+                f = f->next;
+            *sp = stack_vec(f)[i->b];
+            except_on(*sp == VAL_NONE, "Variable used before being bound");
+            ++ sp;
+            break;
+        }
+        case LDF:
+            *sp++ = val_make(CLOSURE, stack_push(e, p->k[i->b]));
+            break;
+        case PRIM:
+            sp -= i->a;
+            *sp = ((awful_key_t) val_p(p->k[i->b]))->routine(sp);
+            ++ sp;
+            break;
+        case SEL:
+            -- sp;
+            except_on(!val_is_number(*sp), "Number expected in COND");
+            if (val_n(*sp) == 0) pc = p->ins + i->b;
+            break;
+        case JMP:
+            pc = p->ins + i->b;
+            break;
+        case CALL:
+        case TAILCALL: {
+            if (stack_gc_due()) {
+                secd_gc_sp = sp;
+                secd_gc_e = e;
+                secd_gc_dp = dp;
+                stack_gc(secd_roots);
+                e = secd_gc_e;
+            }
+            val_t *args = sp - i->a;
+            val_t f = args[-1];
+            except_on(val_type(f) != CLOSURE || val_type(val_s(f)->val) != CODE,
+                "Function expected");
+            secd_proto_t q = val_p(val_s(f)->val);
+            except_on(q->nparams != i->a,
+                "%i actual parameters expected", q->nparams);
+            if (i->op == CALL) {
+                if (dp == secd_d_end) {
+                    size_t i = dp - secd_d;
+                    secd_grow((void**)&secd_d, (void**)&secd_d_end, i + 1,
+                        sizeof(struct secd_dump_s));
+                    dp = secd_d + i;
+                }
+                dp->p = p;
+                dp->pc = pc;
+                dp->e = e;
+                ++ dp;
+            }
+            e = val_s(f)->next;
+            if (i->a > 0) {
+                stack_t frame = stack_new_vec(i->a);
+                memcpy(stack_vec(frame), args, i->a * sizeof(val_t));
+                frame->next = e;
+                e = frame;
+            }
+            sp = secd_grow_s(args - 1, q->maxdepth);
+            p = q;
+            pc = q->ins;
+            break;
+        }
+        case RTN:
+            -- dp;
+            p = dp->p;
+            pc = dp->pc;
+            e = dp->e;
+            break;
+        case ENTER: {
+            stack_t frame = stack_new_vec(i->a);
+            val_t *v = stack_vec(frame);
+            if (i->b > 0) {
+                sp -= i->b;
+                memcpy(v, sp, i->b * sizeof(val_t));
+            } else {
+                for (int j = 0; j < i->a; ++ j)
+                    v[j] = VAL_NONE;
+            }
+            frame->next = e;
+            e = frame;
+            break;
+        }
+        case STORE:
+            // The frame may be older than the value
+            stack_remember(e);
+            stack_vec(e)[i->b] = *--sp;
+            break;
+        case LEAVE:
+            e = e->next;
+            break;
+        case LOOP: {
+            val_t *l = sp - 2;
+            sp = l + secd_loops[i->a].size;
+            if (i->a == SORTBY_LOOP) {
+                secd_sort(l);
+                break;
+            }
+            // The result and its last item start empty
+            l[2] = l[3] = val_make(STACK, NULL);
+            if (i->a == FILTER_LOOP) l[4] = VAL_NONE;
+            break;
+        }
+        case NEXT: {
+            val_t *l = sp - secd_loops[i->a].size;
+            if (i->a == SORTBY_LOOP) {
+                if (!secd_merge(l)) {
+                    sp = l + 1;
+                    pc = p->ins + i->b;
+                    break;
+                }
+                // f is applied to a[j] and a[i]
+                *sp++ = *l;
+                *sp++ = stack_vec(val_s(l[1]))[(unsigned) val_n(l[6])];
+                *sp++ = stack_vec(val_s(l[1]))[(unsigned) val_n(l[5])];
+                break;
+            }
+            val_t *r = l + ((i->a == FOLD_LOOP) ? 2 : 1);
+            except_on(val_type(*r) != STACK, "%s", secd_loops[i->a].error);
+            if (val_s(*r) == NULL) {
+                *l = l[(i->a == FOLD_LOOP) ? 1 : 2];
+                sp = l + 1;
+                pc = p->ins + i->b;
+                break;
+            }
+            val_t y = val_s(*r)->val;
+            *r = val_make(STACK, val_s(*r)->next);
+            *sp++ = *l;
+            if (i->a == FOLD_LOOP) *sp++ = l[1];
+            if (i->a == FILTER_LOOP) l[4] = y;
+            *sp++ = y;
+            break;
+        }
+        case COLLECT: {
+            val_t v = *--sp;
+            val_t *l = sp - secd_loops[i->a].size;
+            if (i->a == FOLD_LOOP) {
+                l[1] = v;
+                break;
+            }
+            if (i->a == SORTBY_LOOP) {
+                // a[j] is taken only if it must precede a[i]
+                except_on(!val_is_number(v), "SORTBY f x needs f to return numbers");
+                int from = (val_n(v) != 0) ? 6 : 5;
+                unsigned k = val_n(l[7]);
+                stack_vec(val_s(l[2]))[k] =
+                    stack_vec(val_s(l[1]))[(unsigned) val_n(l[from])];
+                l[from] = val_number(val_n(l[from]) + 1);
+                l[7] = val_number(k + 1);
+                break;
+            }
+            if (i->a == FILTER_LOOP) {
+                except_on(!val_is_number(v), "FILTER f x needs f to return numbers");
+                if (val_n(v) == 0) break;
+                v = l[4];
+            }
+            // The last item may be older than the new one
+            stack_t t = stack_push(NULL, v);
+            if (val_s(l[2]) == NULL) {
+                l[2] = val_make(STACK, t);
+            } else {
+                stack_remember(val_s(l[3]));
+                val_s(l[3])->next = t;
+            }
+            l[3] = val_make(STACK, t);
+            break;
+        }
+        }
+    }
+}
+
+/** Pass to stack_mark() the values to keep when binding a
+    prelude: the top level environment, the parameters of its
+    scopes and the values used by the prototypes. */
+static void secd_keep_roots(void)
+{
+    secd_mark_s(&secd_top_env);
+    for (secd_scope_t sc = secd_top; sc != NULL; sc = sc->up)
+        secd_mark_s(&sc->params);
+    secd_mark_protos();
+}
+
+void secd_bind(stack_t tokens, val_t h)
+{
+    except_on(val_type(h) != CLOSURE, "Closure expected binding a prelude");
+    // A scope for each closure with parameters, as done by secd_let()
+    while (val_type(tokens->val) == '(' && val_type(tokens->next->val) == '{') {
+        tokens = tokens->next->next;
+        int n;
+        stack_t params = secd_params(&tokens, &n);
+        if (n > 0) {
+            secd_scope_t sc = malloc(sizeof(struct secd_scope_s));
+            except_on(sc == NULL, "Fatal allocation error"
+                " @%s:%i", __FILE__, __LINE__);
+            sc->params = params;
+            sc->up = secd_top;
+            secd_top = sc;
+        }
+    }
+    secd_top_env = val_s(h)->next;
+    stack_keep(secd_keep_roots);
+    // The closures bound may use any prototype compiled so far
+    while (secd_protos != NULL) {
+        secd_proto_t p = secd_protos;
+        secd_protos = p->next;
+        p->next = secd_kept;
+        p->index = secd_nkept ++;
+        secd_kept = p;
+    }
+}
+
+void secd_drop(void)
+{
+    secd_free(&secd_kept);
+    while (secd_top != NULL) {
+        secd_scope_t up = secd_top->up;
+        free(secd_top);
+        secd_top = up;
+    }
+    secd_top_env = NULL;
+    secd_nkept = 0;
+    free(secd_loaded);
+    secd_loaded = NULL;
+}
+
+unsigned secd_index(secd_proto_t p)
+{
+    return p->index;
+}
+
+secd_proto_t secd_at(unsigned i)
+{
+    except_on(i >= secd_nkept || secd_loaded == NULL, "Corrupted image");
+    return secd_loaded[i];
+}
+
+/** Write into the image the items and the values p points to. */
+static void secd_save_proto(secd_proto_t p)
+{
+    unsigned h[4] = {p->n, p->nk, p->nparams, p->maxdepth};
+    image_put(h, sizeof h);
+    image_put(p->ins, p->n * sizeof(secd_ins_t));
+    for (unsigned i = 0; i < p->nk; ++ i) {
+        val_t v = p->k[i];
+        image_val_out(&v);
+        image_put(&v, sizeof v);
+    }
+    stack_t s[3] = {image_item_out(p->params), image_item_out(p->body),
+        image_item_out(p->end)};
+    image_put(s, sizeof s);
+}
+
+void secd_save(void)
+{
+    secd_proto_t *a = malloc((secd_nkept + 1) * sizeof(secd_proto_t));
+    except_on(a == NULL, "Fatal allocation error"
+        " @%s:%i", __FILE__, __LINE__);
+    for (secd_proto_t p = secd_kept; p != NULL; p = p->next)
+        a[p->index] = p;
+    image_put(&secd_nkept, sizeof secd_nkept);
+    for (unsigned i = 0; i < secd_nkept; ++ i)
+        secd_save_proto(a[i]);
+    free(a);
+    // Scopes, innermost first, and the top level environment
+    unsigned n = 0;
+    for (secd_scope_t sc = secd_top; sc != NULL; sc = sc->up)
+        ++ n;
+    image_put(&n, sizeof n);
+    for (secd_scope_t sc = secd_top; sc != NULL; sc = sc->up) {
+        stack_t s = image_item_out(sc->params);
+        image_put(&s, sizeof s);
+    }
+    stack_t s = image_item_out(secd_top_env);
+    image_put(&s, sizeof s);
+}
+
+/** Read from the image the prototype p written by
+    secd_save_proto(). */
+static void secd_load_proto(secd_proto_t p)
+{
+    unsigned h[4];
+    memcpy(h, image_get(sizeof h), sizeof h);
+    p->n = p->size = h[0];
+    p->nk = p->ksize = h[1];
+    p->nparams = h[2];
+    p->maxdepth = h[3];
+    void *ins = image_get(p->n * sizeof(secd_ins_t));
+    void *k = image_get(p->nk * sizeof(val_t));
+    p->ins = malloc(p->n * sizeof(secd_ins_t) + 1);
+    p->k = malloc(p->nk * sizeof(val_t) + 1);
+    except_on(p->ins == NULL || p->k == NULL, "Fatal allocation error"
+        " @%s:%i", __FILE__, __LINE__);
+    memcpy(p->ins, ins, p->n * sizeof(secd_ins_t));
+    memcpy(p->k, k, p->nk * sizeof(val_t));
+    for (unsigned i = 0; i < p->nk; ++ i)
+        image_val_in(p->k + i);
+    stack_t s[3];
+    memcpy(s, image_get(sizeof s), sizeof s);
+    p->params = image_item_in(s[0]);
+    p->body = image_item_in(s[1]);
+    p->end = image_item_in(s[2]);
+}
+
+void secd_load(void)
+{
+    unsigned n;
+    memcpy(&n, image_get(sizeof n), sizeof n);
+    // Each prototype takes at least its header and three items
+    except_on(n > image_left() / (4 * sizeof(unsigned) + 3 * sizeof(stack_t)),
+        "Corrupted image");
+    secd_loaded = calloc(n + 1, sizeof(secd_proto_t));
+    except_on(secd_loaded == NULL, "Fatal allocation error"
+        " @%s:%i", __FILE__, __LINE__);
+    // Keep all prototypes first, so that secd_drop() frees them
+    for (unsigned i = 0; i < n; ++ i) {
+        secd_proto_t p = calloc(1, sizeof(struct secd_proto_s));
+        except_on(p == NULL, "Fatal allocation error"
+            " @%s:%i", __FILE__, __LINE__);
+        p->next = secd_kept;
+        p->index = secd_nkept ++;
+        secd_kept = secd_loaded[i] = p;
+    }
+    for (unsigned i = 0; i < n; ++ i)
+        secd_load_proto(secd_loaded[i]);
+    memcpy(&n, image_get(sizeof n), sizeof n);
+    stack_t *params = image_get(n * sizeof(stack_t));
+    for (unsigned i = n; i-- > 0; ) {
+        secd_scope_t sc = malloc(sizeof(struct secd_scope_s));
+        except_on(sc == NULL, "Fatal allocation error"
+            " @%s:%i", __FILE__, __LINE__);
+        memcpy(&sc->params, params + i, sizeof(stack_t));
+        sc->params = image_item_in(sc->params);
+        sc->up = secd_top;
+        secd_top = sc;
+    }
+    stack_t s;
+    memcpy(&s, image_get(sizeof s), sizeof s);
+    secd_top_env = image_item_in(s);
+}
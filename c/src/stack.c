@@ -1,30 +1,129 @@
 /** \file stack.c */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "../header/except.h"
 #include "../header/stack.h"
 #include "../header/str.h"
 #include "../header/val.h"
 
 /**
-    A chunk is an array of CHUNKSIZ stack items:
-    each stack in the program takes its items
-    from a chunk. The function stack_reset() is
-    used to free all chunks for future reuse.
+    A chunk is an array of stack items: each stack in the
+    program takes its items from the first chunk, the current
+    one, by incrementing its index of the first free item. When
+    it is full, a new chunk is allocated and becomes the current
+    one: each new chunk is twice as large as the previous one,
+    starting from CHUNKSIZ up to CHUNKMAX items. The function
+    stack_reset() is used to free all chunks but the current
+    one, which is reused.
+
+    Items can also be reclaimed before stack_reset() by a
+    generational collector. New items are taken from the nursery,
+    a chunk of stack_nursery_size items, or from overflow chunks
+    allocated if the nursery is full when no collection can be
+    done: they are the young items. A minor collection copies the
+    young items reachable from the roots into old chunks, updating
+    the values which point to them, and next empties the nursery:
+    since values are not changed once created, old items point to
+    young ones only if recorded by stack_remember().
+
+    When enough items have been copied into old chunks, a major
+    collection marks the items reachable from the roots and puts
+    all other old items in a free list, from which copies are
+    taken before looking inside old chunks. Old chunks with no
+    marked items are released.
+
+    Values which have to survive stack_reset(), as the ones bound
+    by preludes, are copied by stack_keep() into permanent chunks,
+    which are not indexed: the collector skips their items, which
+    point only to other permanent items.
 */
 
 #define CHUNKSIZ (1024)
+#define CHUNKMAX (1024 * 1024)
+
+/// Flag of an old item marked by stack_mark()
+#define STACK_MARK (1)
+/// Flag of an item which is the header of a vector
+#define STACK_VEC (2)
+/// Flag of a young item copied into an old chunk, whose address
+/// is stored as next item
+#define STACK_MOVED (4)
+
+/// Minimum number of items to copy between two major collections
+#define STACK_GC_MIN (64 * CHUNKSIZ)
+
+/// Default number of items in the nursery
+#define STACK_NURSERY (64 * CHUNKSIZ)
 
 typedef struct stack_chunk_s {
     struct stack_chunk_s *next;
     unsigned here;  ///< Index of 1ft free item in chunk
-    struct stack_s chunk[CHUNKSIZ];
+    unsigned size;  ///< Number of items in chunk
+    unsigned char *flags;       ///< flags of each item
+    struct stack_s chunk[];     ///< followed by the flags
 } *stack_chunk_t;
 
-/** First chunk of stack items. */
+/** First old chunk, the current one. */
 static stack_chunk_t stack_chunks = NULL;
 
+/** Young chunks: the first one is the current one, the last
+    one is the nursery, the others are overflow chunks. */
+static stack_chunk_t stack_young = NULL, stack_nursery = NULL;
+
+/** Number of items of the nursery. */
+static unsigned stack_nursery_size = STACK_NURSERY;
+
+/** Array of all old chunks, sorted by address, to find the
+    chunk containing an item: stack_nchunks are used and there
+    is room for stack_ichunks of them. */
+static stack_chunk_t *stack_index = NULL;
+static unsigned stack_nchunks = 0, stack_ichunks = 0;
+
+/** List of old items freed by a major collection and its length. */
+static stack_t stack_free = NULL;
+static unsigned stack_nfree = 0;
+
+/** Number of items copied into old chunks since the last major
+    collection, and number of items after which another one is
+    done. */
+static unsigned stack_count = 0, stack_threshold = STACK_GC_MIN;
+
+/** Statistics printed by stack_status(). */
+static unsigned stack_minors = 0, stack_majors = 0;
+static double stack_promoted = 0, stack_freed = 0;
+static double stack_minor_pause = 0, stack_major_pause = 0, stack_max_pause = 0;
+
+/** Nonzero during a minor collection. */
+static int stack_minor = 0;
+
+/** Permanent chunks: the first one is the current one. */
+static stack_chunk_t stack_perm = NULL;
+
+/** Nonzero during stack_keep(). */
+static int stack_keeping = 0;
+
+/** Hash table of the items copied by stack_keep(): each pair
+    of elements contains an item and its permanent copy. There
+    are stack_nfwd pairs and room for stack_sfwd ones. */
+static stack_t *stack_fwd = NULL;
+static unsigned stack_nfwd = 0, stack_sfwd = 0;
+
+/// Hash of the address of an item
+#define STACK_HASH(s) ((unsigned)((uintptr_t)(s) >> 4) * 2654435761u)
+
+/** Stack of items marked or copied by stack_mark() whose values
+    and next items have still to be marked, and its size. */
+static stack_t *stack_gray = NULL;
+static unsigned stack_ngray = 0, stack_igray = 0;
+
+/** Old items recorded by stack_remember(), and their number. */
+static stack_t *stack_remembered = NULL;
+static unsigned stack_nremembered = 0, stack_iremembered = 0;
+
 stack_t stack_dup(stack_t s1, stack_t s2)
 {
     except_on(s1 == NULL, "Cannot pop from empty stack");
@@ -36,28 +135,186 @@ stack_t stack_dup(stack_t s1, stack_t s2)
 
 void stack_fprint(FILE *f, stack_t s)
 {
-    val_t v = {.type = STACK, .val.s = s};
-    val_fprint(f, v);
+    val_fprint(f, val_make(STACK, s));
 }
 
-stack_t stack_new(void)
+/** Append the item s to the array *r_a whose length is *r_n
+    and which has room for *r_size items. */
+static void stack_append(stack_t **r_a, unsigned *r_n, unsigned *r_size,
+    stack_t s)
 {
-    stack_t s = NULL;
-    for (stack_chunk_t c = stack_chunks; c != NULL; c = c->next)
-        if (c->here < CHUNKSIZ) {
-            s = c->chunk + c->here++;
-            break;
-        }
-    // If s == NULL no free chunk was found.
-    if (s == NULL) {
-        stack_chunk_t new_chunk = malloc(sizeof(struct stack_chunk_s));
-        except_on(new_chunk == NULL, "Fatal allocation error"
+    if (*r_n == *r_size) {
+        *r_size = (*r_size == 0) ? 1024 : 2 * *r_size;
+        stack_t *a = realloc(*r_a, *r_size * sizeof(stack_t));
+        except_on(a == NULL, "Fatal allocation error"
             " @%s:%i", __FILE__, __LINE__);
-        new_chunk->next = stack_chunks;
-        s = new_chunk->chunk;
-        new_chunk->here = 1;
-        stack_chunks = new_chunk;
+        *r_a = a;
     }
+    (*r_a)[(*r_n) ++] = s;
+}
+
+/** Insert c inside stack_index, keeping it sorted. */
+static void stack_index_add(stack_chunk_t c)
+{
+    if (stack_nchunks == stack_ichunks) {
+        stack_ichunks = (stack_ichunks == 0) ? 64 : 2 * stack_ichunks;
+        stack_chunk_t *index = realloc(stack_index,
+            stack_ichunks * sizeof(stack_chunk_t));
+        except_on(index == NULL, "Fatal allocation error"
+            " @%s:%i", __FILE__, __LINE__);
+        stack_index = index;
+    }
+    unsigned i = stack_nchunks ++;
+    for (; i > 0 && stack_index[i - 1] > c; -- i)
+        stack_index[i] = stack_index[i - 1];
+    stack_index[i] = c;
+}
+
+/** Return the old chunk containing the item s, NULL if none. */
+static stack_chunk_t stack_chunk_of(stack_t s)
+{
+    unsigned lo = 0, hi = stack_nchunks;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        stack_chunk_t c = stack_index[mid];
+        if (s < c->chunk) hi = mid;
+        else if (s >= c->chunk + c->size) lo = mid + 1;
+        else return c;
+    }
+    return NULL;
+}
+
+/** Return the young chunk containing the item s, NULL if none. */
+static stack_chunk_t stack_young_of(stack_t s)
+{
+    for (stack_chunk_t c = stack_young; c != NULL; c = c->next)
+        if (s >= c->chunk && s < c->chunk + c->here)
+            return c;
+    return NULL;
+}
+
+unsigned stack_vec_items(unsigned n)
+{
+    return 1 + (n * sizeof(val_t) + sizeof(struct stack_s) - 1)
+        / sizeof(struct stack_s);
+}
+
+/** Allocate a chunk of size items and return it. */
+static stack_chunk_t stack_chunk_new(unsigned size)
+{
+    stack_chunk_t c = malloc(sizeof(struct stack_chunk_s)
+        + size * (sizeof(struct stack_s) + 1));
+    except_on(c == NULL, "Fatal allocation error"
+        " @%s:%i", __FILE__, __LINE__);
+    c->here = 0;
+    c->size = size;
+    c->flags = (unsigned char*)(c->chunk + size);
+    memset(c->flags, 0, size);
+    return c;
+}
+
+/** Return the size of a chunk following c, large at least n. */
+static unsigned stack_chunk_size(stack_chunk_t c, unsigned n)
+{
+    unsigned size = (c == NULL) ? CHUNKSIZ
+        : (c->size < CHUNKMAX) ? 2 * c->size : CHUNKMAX;
+    while (size < n)
+        size *= 2;
+    return size;
+}
+
+/** Return the address of n consecutive young items: if the
+    current young chunk is full, an overflow chunk is allocated. */
+static stack_t stack_alloc(unsigned n)
+{
+    stack_chunk_t c = stack_young;
+    if (c == NULL) {
+        c = stack_young = stack_nursery = stack_chunk_new(stack_nursery_size);
+        c->next = NULL;
+    }
+    if (c->here + n > c->size) {
+        c = stack_chunk_new(stack_chunk_size(c, n));
+        c->next = stack_young;
+        stack_young = c;
+    }
+    stack_t s = c->chunk + c->here;
+    c->here += n;
+    return s;
+}
+
+/** Return the address of n consecutive old items, taken from the
+    free list if n == 1, else from the current old chunk: if it
+    is full, a new one becomes the current chunk and the items
+    left in the old one go to the free list. */
+static stack_t stack_alloc_old(unsigned n)
+{
+    stack_count += n;
+    if (n == 1 && stack_free != NULL) {
+        stack_t s = stack_free;
+        stack_free = s->next;
+        -- stack_nfree;
+        return s;
+    }
+    stack_chunk_t c = stack_chunks;
+    if (c == NULL || c->here + n > c->size) {
+        if (c != NULL)
+            for (; c->here < c->size; ++ c->here) {
+                c->chunk[c->here].next = stack_free;
+                stack_free = c->chunk + c->here;
+                ++ stack_nfree;
+            }
+        c = stack_chunk_new(stack_chunk_size(c, n));
+        c->next = stack_chunks;
+        stack_chunks = c;
+        stack_index_add(c);
+    }
+    stack_t s = c->chunk + c->here;
+    c->here += n;
+    return s;
+}
+
+/** Return the address of n consecutive permanent items. */
+static stack_t stack_alloc_perm(unsigned n)
+{
+    stack_chunk_t c = stack_perm;
+    if (c == NULL || c->here + n > c->size) {
+        c = stack_chunk_new(stack_chunk_size(c, n));
+        c->next = stack_perm;
+        stack_perm = c;
+    }
+    stack_t s = c->chunk + c->here;
+    c->here += n;
+    return s;
+}
+
+stack_t stack_new(void)
+{
+    // Inline the most frequent case
+    stack_chunk_t c = stack_young;
+    if (c != NULL && c->here < c->size)
+        return c->chunk + c->here ++;
+    return stack_alloc(1);
+}
+
+stack_t stack_new_vec(unsigned n)
+{
+    // Number of items needed to store the header and n values
+    unsigned items = stack_vec_items(n);
+    except_on(items > CHUNKMAX, "Vector too large: %u items", n);
+    stack_t s = stack_alloc(items);
+    stack_young->flags[s - stack_young->chunk] |= STACK_VEC;
+    s->next = NULL;
+    s->val = val_number(n);
+    return s;
+}
+
+stack_t stack_new_list(unsigned n)
+{
+    if (n == 0) return NULL;
+    stack_t s = stack_alloc(n);
+    for (unsigned i = 0; i + 1 < n; ++ i)
+        s[i].next = s + i + 1;
+    s[n - 1].next = NULL;
     return s;
 }
 
@@ -68,8 +325,8 @@ stack_t stack_next(stack_t s)
 
 stack_t stack_push(stack_t s, val_t v)
 {
-    except_on(v.type < 0 || v.type > 127, "BUG!"
-        " @%s:%i [t = %i", __FILE__, __LINE__, v.type);
+    except_on(val_type(v) > 127, "BUG!"
+        " @%s:%i [t = %i", __FILE__, __LINE__, val_type(v));
     stack_t tos = stack_new();
     tos->val = v;
     tos->next = s;
@@ -78,18 +335,389 @@ stack_t stack_push(stack_t s, val_t v)
 
 stack_t stack_push_s(stack_t s, stack_t s1)
 {
-    val_t v = {.type = STACK, .val.s = s1};
-    return stack_push(s, v);
+    return stack_push(s, val_make(STACK, s1));
+}
+
+/** Empty the young chunks, freeing the overflow ones: the
+    nursery is resized if needed. */
+static void stack_young_reset(void)
+{
+    while (stack_young != stack_nursery) {
+        stack_chunk_t c = stack_young;
+        stack_young = c->next;
+        free(c);
+    }
+    if (stack_nursery != NULL && stack_nursery->size != stack_nursery_size) {
+        free(stack_nursery);
+        stack_young = stack_nursery = NULL;
+    } else if (stack_nursery != NULL) {
+        memset(stack_nursery->flags, 0, stack_nursery->here);
+        stack_nursery->here = 0;
+    }
+    stack_nremembered = 0;
 }
 
 void stack_reset(void)
 {
-    for (stack_chunk_t c = stack_chunks; c != NULL; c = c->next) {
-        c->here = 0;
+    stack_young_reset();
+    // Keep the current chunk, unless it is too large
+    stack_chunk_t keep = NULL;
+    if (stack_chunks != NULL && stack_chunks->size <= STACK_GC_MIN) {
+        keep = stack_chunks;
+        stack_chunks = stack_chunks->next;
     }
+    while (stack_chunks != NULL) {
+        stack_chunk_t c = stack_chunks;
+        stack_chunks = c->next;
+        free(c);
+    }
+    stack_nchunks = 0;
+    if (keep != NULL) {
+        keep->next = NULL;
+        keep->here = 0;
+        memset(keep->flags, 0, keep->size);
+        stack_chunks = keep;
+        stack_index_add(keep);
+    }
+    stack_free = NULL;
+    stack_nfree = 0;
+    stack_count = 0;
     str_reset();
 }
 
+void stack_set_nursery(size_t bytes)
+{
+    unsigned n = bytes / sizeof(struct stack_s);
+    stack_nursery_size = (n < CHUNKSIZ) ? CHUNKSIZ : n;
+}
+
+void stack_remember(stack_t s)
+{
+    if (stack_young_of(s) == NULL)
+        stack_append(&stack_remembered, &stack_nremembered,
+            &stack_iremembered, s);
+}
+
+/** Return the address of the copy of the young item s inside an
+    old chunk, copying it if not already done: the copy is pushed
+    on stack_gray to copy the young items it points to. */
+static stack_t stack_copy(stack_t s, stack_chunk_t c)
+{
+    unsigned i = s - c->chunk;
+    if (c->flags[i] & STACK_MOVED)
+        return s->next;
+    unsigned items = (c->flags[i] & STACK_VEC)
+        ? stack_vec_items(stack_vec_len(s)) : 1;
+    stack_t d = stack_alloc_old(items);
+    memcpy(d, s, items * sizeof(struct stack_s));
+    if (c->flags[i] & STACK_VEC)
+        stack_chunks->flags[d - stack_chunks->chunk] |= STACK_VEC;
+    stack_promoted += items * sizeof(struct stack_s);
+    c->flags[i] |= STACK_MOVED;
+    s->next = d;
+    stack_append(&stack_gray, &stack_ngray, &stack_igray, d);
+    return d;
+}
+
+/** Return the index of the pair of stack_fwd containing the
+    item s, or of the empty pair where to insert it. */
+static unsigned stack_fwd_find(stack_t s)
+{
+    unsigned mask = stack_sfwd - 1;
+    unsigned h = STACK_HASH(s) & mask;
+    while (stack_fwd[2 * h] != NULL && stack_fwd[2 * h] != s)
+        h = (h + 1) & mask;
+    return h;
+}
+
+/** Insert into stack_fwd the item s and its copy d, enlarging
+    the table if it is half full. */
+static void stack_fwd_add(stack_t s, stack_t d)
+{
+    if (2 * (stack_nfwd + 1) > stack_sfwd) {
+        stack_t *fwd = stack_fwd;
+        unsigned n = stack_sfwd;
+        stack_sfwd = (n == 0) ? 1024 : 2 * n;
+        stack_fwd = calloc(2 * stack_sfwd, sizeof(stack_t));
+        except_on(stack_fwd == NULL, "Fatal allocation error"
+            " @%s:%i", __FILE__, __LINE__);
+        for (unsigned i = 0; i < n; ++ i)
+            if (fwd[2 * i] != NULL) {
+                unsigned h = stack_fwd_find(fwd[2 * i]);
+                stack_fwd[2 * h] = fwd[2 * i];
+                stack_fwd[2 * h + 1] = fwd[2 * i + 1];
+            }
+        free(fwd);
+    }
+    unsigned h = stack_fwd_find(s);
+    stack_fwd[2 * h] = s;
+    stack_fwd[2 * h + 1] = d;
+    ++ stack_nfwd;
+}
+
+/** Return the permanent copy of the item s, copying it if not
+    already done: items outside young and old chunks already are
+    permanent. The copy and s are pushed on stack_gray, to copy
+    the items s points to. */
+static stack_t stack_keep_item(stack_t s)
+{
+    stack_chunk_t c = stack_young_of(s);
+    if (c == NULL && (c = stack_chunk_of(s)) == NULL)
+        return s;
+    if (stack_nfwd > 0) {
+        unsigned h = stack_fwd_find(s);
+        if (stack_fwd[2 * h] == s)
+            return stack_fwd[2 * h + 1];
+    }
+    unsigned items = (c->flags[s - c->chunk] & STACK_VEC)
+        ? stack_vec_items(stack_vec_len(s)) : 1;
+    stack_t d = stack_alloc_perm(items);
+    memcpy(d, s, items * sizeof(struct stack_s));
+    if (c->flags[s - c->chunk] & STACK_VEC)
+        stack_perm->flags[d - stack_perm->chunk] |= STACK_VEC;
+    stack_fwd_add(s, d);
+    stack_append(&stack_gray, &stack_ngray, &stack_igray, d);
+    stack_append(&stack_gray, &stack_ngray, &stack_igray, s);
+    return d;
+}
+
+/** Process the item *r_s, if not NULL: during a minor collection
+    it is replaced by its copy if young, else it is marked and
+    pushed on stack_gray, if not already marked. During
+    stack_keep() it is replaced by its permanent copy. */
+static void stack_gray_push(stack_t *r_s)
+{
+    stack_t s = *r_s;
+    if (s == NULL) return;
+    if (stack_keeping) {
+        *r_s = stack_keep_item(s);
+        return;
+    }
+    if (stack_minor) {
+        stack_chunk_t c = stack_young_of(s);
+        if (c != NULL) *r_s = stack_copy(s, c);
+        return;
+    }
+    stack_chunk_t c = stack_chunk_of(s);
+    if (c == NULL || c->flags[s - c->chunk] & STACK_MARK) return;
+    c->flags[s - c->chunk] |= STACK_MARK;
+    stack_append(&stack_gray, &stack_ngray, &stack_igray, s);
+}
+
+/** Process the item the value *v points to, if any: '(' and '{'
+    tokens point to the matching ')' and '}'. During stack_keep()
+    the strings of atoms and strings are kept too. */
+static void stack_gray_val(val_t *v)
+{
+    if (val_is_number(*v)) return;
+    int t = val_type(*v);
+    if (stack_keeping && (t == ATOM || t == STRING))
+        str_keep(val_str(*v));
+    if (t == STACK || t == CLOSURE || t == VECTOR || t == '(' || t == '{') {
+        stack_t s = val_s(*v);
+        stack_gray_push(&s);
+        *v = val_with_p(*v, s);
+    }
+}
+
+/** Process the values and the next item of all items inside
+    stack_gray, which are old ones. */
+static void stack_gray_drain(void)
+{
+    while (stack_ngray > 0) {
+        stack_t s = stack_gray[-- stack_ngray];
+        stack_chunk_t c = stack_chunk_of(s);
+        if (c->flags[s - c->chunk] & STACK_VEC) {
+            val_t *w = stack_vec(s);
+            for (unsigned i = 0; i < stack_vec_len(s); ++ i)
+                stack_gray_val(w + i);
+        } else {
+            stack_gray_val(&s->val);
+        }
+        stack_gray_push(&s->next);
+    }
+}
+
+/** Process the values and the next items of the permanent copies
+    inside stack_gray, each one pushed before its original. */
+static void stack_keep_drain(void)
+{
+    while (stack_ngray > 0) {
+        stack_t s = stack_gray[-- stack_ngray];
+        stack_t d = stack_gray[-- stack_ngray];
+        stack_chunk_t c = stack_young_of(s);
+        if (c == NULL) c = stack_chunk_of(s);
+        if (c->flags[s - c->chunk] & STACK_VEC) {
+            val_t *w = stack_vec(d);
+            for (unsigned i = 0; i < stack_vec_len(d); ++ i)
+                stack_gray_val(w + i);
+        } else {
+            stack_gray_val(&d->val);
+        }
+        stack_gray_push(&d->next);
+    }
+}
+
+void stack_mark(val_t *v, unsigned n)
+{
+    while (n-- > 0)
+        stack_gray_val(v++);
+    if (stack_keeping) stack_keep_drain();
+    else stack_gray_drain();
+}
+
+void stack_keep(void (*roots)(void))
+{
+    stack_keeping = 1;
+    roots();
+    stack_keeping = 0;
+    free(stack_fwd);
+    stack_fwd = NULL;
+    stack_nfwd = stack_sfwd = 0;
+}
+
+void stack_drop(void)
+{
+    while (stack_perm != NULL) {
+        stack_chunk_t c = stack_perm;
+        stack_perm = c->next;
+        free(c);
+    }
+    str_release();
+}
+
+unsigned stack_perm_copy(stack_t items, unsigned char *vec)
+{
+    unsigned n = 0;
+    for (stack_chunk_t c = stack_perm; c != NULL; c = c->next) {
+        if (items != NULL) {
+            memcpy(items + n, c->chunk, c->here * sizeof(struct stack_s));
+            for (unsigned i = 0; i < c->here; ++ i)
+                vec[n + i] = (c->flags[i] & STACK_VEC) != 0;
+        }
+        n += c->here;
+    }
+    return n;
+}
+
+unsigned stack_perm_index(stack_t s)
+{
+    if (s == NULL) return 0;
+    unsigned n = 1;
+    for (stack_chunk_t c = stack_perm; c != NULL; c = c->next) {
+        if (s >= c->chunk && s < c->chunk + c->here)
+            return n + (s - c->chunk);
+        n += c->here;
+    }
+    except_on(1, "BUG: item not permanent @%s:%i", __FILE__, __LINE__);
+    return 0;
+}
+
+stack_t stack_perm_new(unsigned n, const unsigned char *vec)
+{
+    stack_t s = stack_alloc_perm(n);
+    for (unsigned i = 0; i < n; ++ i)
+        if (vec[i]) stack_perm->flags[s - stack_perm->chunk + i] |= STACK_VEC;
+    return s;
+}
+
+int stack_gc_due(void)
+{
+    return stack_young != NULL
+        && (stack_young != stack_nursery || 4 * stack_nursery->here
+            >= 3 * stack_nursery->size);
+}
+
+/** Free all old items not marked, collecting statistics. */
+static void stack_sweep(void)
+{
+    unsigned live = 0, nfree = 0, released = 0;
+    stack_free = NULL;
+    for (stack_chunk_t *r_c = &stack_chunks; *r_c != NULL; ) {
+        stack_chunk_t c = *r_c;
+        unsigned used = 0;
+        for (unsigned i = 0; i < c->here; ++ i)
+            used += c->flags[i] & STACK_MARK;
+        if (used == 0) {
+            // Release the chunk
+            *r_c = c->next;
+            unsigned j = 0;
+            while (stack_index[j] != c) ++ j;
+            memmove(stack_index + j, stack_index + j + 1,
+                (-- stack_nchunks - j) * sizeof(stack_chunk_t));
+            released += c->here;
+            free(c);
+            continue;
+        }
+        for (unsigned i = 0; i < c->here; ) {
+            unsigned k = (c->flags[i] & STACK_VEC)
+                ? stack_vec_items(stack_vec_len(c->chunk + i)) : 1;
+            if (c->flags[i] & STACK_MARK) {
+                c->flags[i] &= ~STACK_MARK;
+                live += k;
+            } else {
+                c->flags[i] = 0;
+                for (unsigned j = i; j < i + k; ++ j) {
+                    c->chunk[j].next = stack_free;
+                    stack_free = c->chunk + j;
+                }
+                nfree += k;
+            }
+            i += k;
+        }
+        r_c = &c->next;
+    }
+    // Items already in the free list are not counted as freed
+    stack_freed += (double)(nfree + released - stack_nfree)
+        * sizeof(struct stack_s);
+    stack_nfree = nfree;
+    stack_count = 0;
+    // Next collection when free items are exhausted, but copy
+    // at least as many items as the live ones
+    unsigned avail = nfree;
+    if (stack_chunks != NULL)
+        avail += stack_chunks->size - stack_chunks->here;
+    if (avail < live) avail = live;
+    stack_threshold = (avail > STACK_GC_MIN) ? avail : STACK_GC_MIN;
+}
+
+void stack_gc(void (*roots)(void))
+{
+    clock_t t = clock();
+    // Minor collection: copy the young items reachable from
+    // the roots and from the remembered items
+    stack_minor = 1;
+    roots();
+    for (unsigned i = 0; i < stack_nremembered; ++ i) {
+        stack_t s = stack_remembered[i];
+        stack_chunk_t c = stack_chunk_of(s);
+        if (c != NULL && c->flags[s - c->chunk] & STACK_VEC) {
+            val_t *w = stack_vec(s);
+            for (unsigned j = 0; j < stack_vec_len(s); ++ j)
+                stack_gray_val(w + j);
+        } else {
+            stack_gray_val(&s->val);
+            stack_gray_push(&s->next);
+        }
+        stack_gray_drain();
+    }
+    stack_minor = 0;
+    stack_young_reset();
+    ++ stack_minors;
+    clock_t t1 = clock();
+    stack_minor_pause += (double) (t1 - t) / CLOCKS_PER_SEC;
+    // Major collection
+    if (stack_count >= stack_threshold) {
+        roots();
+        stack_sweep();
+        ++ stack_majors;
+        stack_major_pause += (double) (clock() - t1) / CLOCKS_PER_SEC;
+    }
+    t = clock() - t;
+    if (stack_max_pause < (double) t / CLOCKS_PER_SEC)
+        stack_max_pause = (double) t / CLOCKS_PER_SEC;
+}
+
 stack_t stack_reverse(stack_t s)
 {
     if (s != NULL) {
@@ -111,8 +739,32 @@ void stack_status(FILE *dump)
     unsigned mem = 0;
     unsigned n = 0;
     for (stack_chunk_t c = stack_chunks; c != NULL; c = c->next) {
-        mem += sizeof(struct stack_chunk_s);
+        mem += sizeof(struct stack_chunk_s)
+            + c->size * (sizeof(struct stack_s) + 1);
         n += c->here;
     }
-    fprintf(dump, "\n%u stack items (%u Kbytes)\n", n, mem / 1024);
+    unsigned young = 0, ymem = 0;
+    for (stack_chunk_t c = stack_young; c != NULL; c = c->next) {
+        ymem += sizeof(struct stack_chunk_s)
+            + c->size * (sizeof(struct stack_s) + 1);
+        young += c->here;
+    }
+    fprintf(dump, "\n%u old stack items (%u Kbytes), %u free\n",
+        n - stack_nfree, mem / 1024, stack_nfree);
+    fprintf(dump, "%u young stack items (%u Kbytes), nursery of %u"
+        " Kbytes\n", young, ymem / 1024, (unsigned)(stack_nursery_size
+        * sizeof(struct stack_s) / 1024));
+    unsigned perm = 0, pmem = 0;
+    for (stack_chunk_t c = stack_perm; c != NULL; c = c->next) {
+        pmem += sizeof(struct stack_chunk_s)
+            + c->size * (sizeof(struct stack_s) + 1);
+        perm += c->here;
+    }
+    fprintf(dump, "%u permanent stack items (%u Kbytes)\n", perm,
+        pmem / 1024);
+    fprintf(dump, "%u minor collections (%.3f ms), %.0f Kbytes promoted\n",
+        stack_minors, 1000 * stack_minor_pause, stack_promoted / 1024);
+    fprintf(dump, "%u major collections (%.3f ms), %.0f Kbytes freed\n",
+        stack_majors, 1000 * stack_major_pause, stack_freed / 1024);
+    fprintf(dump, "max pause %.3f ms\n", 1000 * stack_max_pause);
 }
@@ -1,58 +1,203 @@
 /** \file str.c */
 
+// fileno() is POSIX, not C99
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define STR_MMAP
+#endif
 #include "../header/except.h"
 #include "../header/stack.h"
 #include "../header/str.h"
 
 /**
     Strings are stored into a hash table whose elements
-    are stack items: each item of the stack contains
-    a string whose hash encoding is the same.
-    
+    are lists: each item of a list contains a string whose
+    hash encoding, modulo the table size, is the same.
+
     When a string is created, it is inserted or retrieved
-    from the table.
+    from the table, which is doubled when it contains more
+    strings than elements, so that lists are short. Each
+    item keeps the full hash of its string, so that strings
+    are compared only if their hashes are equal.
+
+    Items are allocated, together with their strings, inside
+    arenas of STR_ARENA bytes, from the current one: an arena
+    counts the items it contains, and it is freed as soon as
+    all of them have been freed.
+
+    The table survives str_reset(), which is called after each
+    expression has been evaluated, so that names and literals
+    recurring in a session are interned once: str_reset() only
+    frees the strings not used by the last STR_KEEP expressions,
+    which cannot be referenced any more since stack_reset() has
+    freed all values, but for the strings kept by str_keep(),
+    which are referenced by permanent values, and those counted
+    by str_ref(), which are referenced by cached translations.
 */
 
-#define TABSIZE (1024)  /* Need to be a power of 2 */
+#define TABSIZE (1024)  /* Initial size: need to be a power of 2 */
+
+/// Number of calls to str_reset() a string survives if unused
+#define STR_KEEP (16)
+
+/// Size of an arena
+#define STR_ARENA (64 << 10)
+
+/** An arena contains items which are allocated one after
+    the other in its mem array, from the here-th byte. */
+typedef struct str_arena_s {
+    size_t here;    // first free byte of mem
+    size_t size;    // number of bytes of mem
+    size_t live;    // number of items in mem
+    char mem[];
+} *str_arena_t;
 
 typedef struct str_table_s {
     struct str_table_s *next;
-    char *s;    // immutable string
-    unsigned l; // its length
+    str_arena_t arena;  // where it is allocated
+    unsigned l;     // its length
+    unsigned h;     // its hash
+    unsigned gen;   // value of str_gen when last used
+    unsigned keep;  // nonzero if kept by str_keep()
+    unsigned refs;  // number of str_ref() not undone by str_unref()
+    char s[];       // immutable string
 } *str_table_t;
 
-/** The string table is an array indexed by string hashes:
-    each item points to a str_table_t with the list of all
-    strings with that same hash. */
-static str_table_t str_table[TABSIZE] = {0};
+/** Number of calls to str_reset() done so far. */
+static unsigned str_gen = 0;
 
-/** Allocate a new item in the h-th element of the string
-    table and return its address. */
-static str_table_t str_table_new(unsigned h)
-{
-    str_table_t item = malloc(sizeof(struct str_table_s));
-    except_on(item == NULL, "Cannot allocate string %s:%i",
-        __FILE__, __LINE__);
-    // Push item in front of the list str_table[h]
-    item->next = str_table[h];
-    return str_table[h] = item;
-}
+/** Total number of bytes freed by str_reset(). */
+static double str_freed = 0;
+
+/** Arena where items are currently allocated. */
+static str_arena_t str_arena = NULL;
+
+/** Number of bytes of all arenas. */
+static double str_arenas = 0;
+
+/** The string table is an array indexed by string hashes
+    modulo str_size: each item points to a str_table_t with
+    the list of all strings with that same index. */
+static str_table_t *str_table = NULL;
+
+/** Number of elements of str_table, a power of 2. */
+static unsigned str_size = 0;
 
-/** Simple minded hash function. The h parameter is used to
-    compute the hash of a concatenation of strings s1 + s2:
-    call str_hash(str_hash(0,s1,strlen(s1)),s2, strlen(s2). */
+/** Number of strings inside str_table. */
+static unsigned str_count = 0;
+
+/** Initial value of the hash function. */
+#define STR_SEED (2166136261u)
+
+/** FNV-1a hash function. The h parameter is used to compute
+    the hash of a concatenation of strings s1 + s2: call
+    str_hash(str_hash(STR_SEED,s1,strlen(s1)),s2,strlen(s2)). */
 static unsigned str_hash(unsigned h, const char *s, size_t n)
 {
     while (n > 0) {
-        h += ((unsigned)*s++) * 257;
-        h &= TABSIZE - 1;
+        h = (h ^ (unsigned char) *s++) * 16777619u;
         -- n;
     }
     return h;
 }
 
+/** Resize the string table to n elements, n a power of 2,
+    moving each item to the list of its new index. */
+static void str_resize(unsigned n)
+{
+    str_table_t *table = calloc(n, sizeof(str_table_t));
+    except_on(table == NULL, "Cannot allocate string table %s:%i",
+        __FILE__, __LINE__);
+    for (unsigned i = 0; i < str_size; ++ i)
+        for (str_table_t p = str_table[i], next; p != NULL; p = next) {
+            next = p->next;
+            p->next = table[p->h & (n - 1)];
+            table[p->h & (n - 1)] = p;
+        }
+    free(str_table);
+    str_table = table;
+    str_size = n;
+}
+
+/** Return a new arena of size bytes. */
+static str_arena_t str_arena_new(unsigned size)
+{
+    str_arena_t a = malloc(sizeof(struct str_arena_s) + size);
+    except_on(a == NULL, "Cannot allocate string %s:%i",
+        __FILE__, __LINE__);
+    a->here = a->live = 0;
+    a->size = size;
+    str_arenas += size;
+    return a;
+}
+
+/** Allocate n bytes, aligned as pointers, inside the current
+    arena, replaced by a new one if needed, and return their
+    address: big items get an arena on their own. */
+static str_table_t str_alloc(unsigned n)
+{
+    n = (n + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    str_arena_t a = str_arena;
+    if (n > STR_ARENA / 4) {
+        a = str_arena_new(n);
+    } else if (a == NULL || a->here + n > a->size) {
+        a = str_arena = str_arena_new(STR_ARENA);
+    }
+    str_table_t item = (str_table_t) (a->mem + a->here);
+    a->here += n;
+    ++ a->live;
+    item->arena = a;
+    return item;
+}
+
+/** Free an item, and its arena if it contains no more items:
+    the current arena is emptied instead. */
+static void str_free(str_table_t item)
+{
+    str_arena_t a = item->arena;
+    if (-- a->live > 0) return;
+    if (a == str_arena) {
+        a->here = 0;
+    } else {
+        str_arenas -= a->size;
+        free(a);
+    }
+}
+
+/** Allocate a new item for a string of length n and hash h
+    in the string table and return its address. */
+static str_table_t str_table_new(unsigned h, unsigned n)
+{
+    if (str_count >= str_size)
+        str_resize(str_size == 0 ? TABSIZE : 2 * str_size);
+    str_table_t item = str_alloc(sizeof(struct str_table_s) + n + 1);
+    item->l = n;
+    item->h = h;
+    item->gen = str_gen;
+    item->keep = 0;
+    item->refs = 0;
+    // Push item in front of its list
+    item->next = str_table[h & (str_size - 1)];
+    ++ str_count;
+    return str_table[h & (str_size - 1)] = item;
+}
+
+/** Return the first item of the list where a string with
+    hash h is found, if any. */
+static str_table_t str_table_find(unsigned h)
+{
+    return (str_size == 0) ? NULL : str_table[h & (str_size - 1)];
+}
+
 char *str_cat(const char *s1, const char *s2)
 {
     size_t l1 = (s1 == NULL) ? -1 : strlen(s1);
@@ -62,19 +207,17 @@ char *str_cat(const char *s1, const char *s2)
     if (l2 == -1) return str_new(s1, l1);
     size_t l3 = l1 + l2;
     // Looks for s1 + s2 inside the table
-    unsigned h = str_hash(str_hash(0, s1, l1), s2, l2);
-    for (str_table_t p = str_table[h]; p != NULL; p = p->next)
+    unsigned h = str_hash(str_hash(STR_SEED, s1, l1), s2, l2);
+    for (str_table_t p = str_table_find(h); p != NULL; p = p->next)
         // Compare character-wise including the final '\0'.
-        if (p->l == l3 && memcmp(p->s, s1, l1) == 0
-        && memcmp(p->s + l1, s2, l2) == 0)
+        if (p->h == h && p->l == l3 && memcmp(p->s, s1, l1) == 0
+        && memcmp(p->s + l1, s2, l2) == 0) {
+            p->gen = str_gen;
             return p->s;
+        }
     // The string is new: allocate it.
-    char *s3 = malloc(l3 + 1);
-    except_on(s3 == NULL, "Cannot allocate string %s:%i",
-        __FILE__, __LINE__);
-    str_table_t item = str_table_new(h);
-    item->l = l3;
-    return item->s = strcat(strcpy(s3, s1), s2);
+    str_table_t item = str_table_new(h, l3);
+    return strcat(strcpy(item->s, s1), s2);
 }
 
 char *str_new(const char *s, size_t n)
@@ -82,45 +225,77 @@ char *str_new(const char *s, size_t n)
     /*  Insert a string into the table and return its address:
         if the string already is in, retrieves its address.
         If n = 0 don't allocate the string but use s. */
-    unsigned h = str_hash(0, s, n);
-    for (str_table_t p = str_table[h]; p != NULL; p = p->next)
+    unsigned h = str_hash(STR_SEED, s, n);
+    for (str_table_t p = str_table_find(h); p != NULL; p = p->next)
         // Compare character-wise including the final '\0'.
-        if (p->l == n && memcmp(p->s, s, n) == 0)
+        if (p->h == h && p->l == n && memcmp(p->s, s, n) == 0) {
+            p->gen = str_gen;
             return p->s;
-    str_table_t item = str_table_new(h);
-    item->s = malloc(n + 1);
-    item->l = n;
-    except_on(item->s == NULL, "Cannot allocate string %s:%i",
-        __FILE__, __LINE__);
+        }
+    str_table_t item = str_table_new(h, n);
     item->s[n] = '\0';
     return memcpy(item->s, s, n);
 }
 
 void str_reset(void)
 {
-    // Free all strings in the table
-    for (unsigned h = 0; h < TABSIZE; ++ h) {
-        str_table_t p = str_table[h];
-        while (p != NULL) {
-            str_table_t next = p->next;
-            free(p->s);
-            free(p);
-            p = next;
+    // Free the strings not used by the last STR_KEEP expressions
+    ++ str_gen;
+    for (unsigned h = 0; h < str_size; ++ h) {
+        for (str_table_t *r_p = &str_table[h]; *r_p != NULL; ) {
+            str_table_t p = *r_p;
+            if (p->keep == 0 && p->refs == 0 && str_gen - p->gen > STR_KEEP) {
+                *r_p = p->next;
+                str_freed += p->l + 1;
+                -- str_count;
+                str_free(p);
+            } else {
+                r_p = &p->next;
+            }
         }
-        str_table[h] = NULL;
     }
 }
 
+void str_keep(const char *s)
+{
+    str_table_t p = (str_table_t)(s - offsetof(struct str_table_s, s));
+    p->keep = 1;
+}
+
+void str_ref(const char *s)
+{
+    ++ ((str_table_t)(s - offsetof(struct str_table_s, s)))->refs;
+}
+
+void str_unref(const char *s)
+{
+    str_table_t p = (str_table_t)(s - offsetof(struct str_table_s, s));
+    -- p->refs;
+    p->gen = str_gen;
+}
+
+unsigned str_hash_of(const char *s)
+{
+    return ((str_table_t)(s - offsetof(struct str_table_s, s)))->h;
+}
+
+void str_release(void)
+{
+    for (unsigned h = 0; h < str_size; ++ h)
+        for (str_table_t p = str_table[h]; p != NULL; p = p->next)
+            p->keep = 0;
+}
+
 void str_status(FILE *dump)
 {
-    int n = 0;
-    unsigned size = 0;
-    for (int i = 0; i < TABSIZE; ++ i)
-        for (str_table_t p = str_table[i]; p != NULL; p = p->next) {
-            ++ n;
-            size += strlen(p->s);
-        }
-    fprintf(dump, "%i strings (%u Kbytes)\n", n, size / 1024);
+    double size = 0;
+    for (unsigned i = 0; i < str_size; ++ i)
+        for (str_table_t p = str_table[i]; p != NULL; p = p->next)
+            size += p->l + 1;
+    fprintf(dump, "%u strings retained (%.0f Kbytes) in %u lists, "
+        "%.0f Kbytes freed\n", str_count, size / 1024, str_size,
+        str_freed / 1024);
+    fprintf(dump, "%.0f Kbytes of string arenas\n", str_arenas / 1024);
 }
 
 /** Return the address of the substring of s which is stripped
@@ -132,8 +307,50 @@ char *str_strip(char *s)
 {
     s += strspn(s, " \t\n\r");    // skip spaces
     size_t len = strlen(s);
-    while (--len > 0 && strchr(" \t\n\r", s[len]))
-        ;
-    s[len + 1] = '\0';
+    while (len > 0 && strchr(" \t\n\r", s[len - 1]))
+        -- len;
+    s[len] = '\0';
     return s;
 }
+
+char *str_map(FILE *f, size_t *r_size)
+{
+    *r_size = 0;
+#ifdef STR_MMAP
+    struct stat st;
+    if (fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode)
+    && st.st_size % sysconf(_SC_PAGESIZE) != 0) {
+        // The rest of the last page is filled by '\0'
+        char *text = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE, fileno(f), 0);
+        if (text != MAP_FAILED) {
+            *r_size = st.st_size;
+            return text;
+        }
+    }
+#endif
+    // Read the file by chunks
+    size_t len = 0, size = BUFSIZ, n;
+    char *text = malloc(size);
+    while (text != NULL && (n = fread(text + len, 1, size - len - 1, f)) > 0) {
+        len += n;
+        if (len + 1 == size) {
+            char *t = realloc(text, size *= 2);
+            if (t == NULL) free(text);
+            text = t;
+        }
+    }
+    if (text != NULL) text[len] = '\0';
+    return text;
+}
+
+void str_unmap(char *text, size_t size)
+{
+#ifdef STR_MMAP
+    if (size > 0) {
+        munmap(text, size);
+        return;
+    }
+#endif
+    free(text);
+}
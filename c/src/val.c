@@ -1,6 +1,7 @@
 /** \file val.c */
 
 #include <stdio.h>
+#include "../header/secd.h"
 #include "../header/stack.h"
 #include "../header/val.h"
 
@@ -16,41 +17,60 @@ static void val_list_fprint(FILE *f, stack_t s)
 
 void val_fprint(FILE *f, val_t v)
 {
-    switch (v.type) {
+    switch (val_type(v)) {
     case NONE: fputs("NONE", f); break;
-    case NUMBER: fprintf(f, "%g", v.val.n); break;
-    case STRING: fprintf(f, "'%s'", v.val.t); break;
-    case ATOM: fputs(v.val.t, f); break;
-    case KEYWORD: fprintf(f, "<keyword %p>", v.val.p); break;
+    case NUMBER: fprintf(f, "%g", val_n(v)); break;
+    case STRING: fprintf(f, "'%s'", val_str(v)); break;
+    case ATOM: fputs(val_str(v), f); break;
+    case KEYWORD: fprintf(f, "<keyword %p>", val_p(v)); break;
     case STACK: {
         fputc('[', f);
-        val_list_fprint(f, v.val.s);
+        val_list_fprint(f, val_s(v));
+        fputc(']', f);
+        break;
+    }
+    case VECTOR: {
+        stack_t s = val_s(v);
+        fputs("vec [", f);
+        for (unsigned i = 0; i < stack_vec_len(s); ++ i) {
+            if (i > 0) fputc(',', f);
+            val_fprint(f, stack_vec(s)[i]);
+        }
         fputc(']', f);
         break;
     }
     case CLOSURE: {
+        stack_t s = val_s(v);
+        if (val_type(s->val) == CODE) {
+            secd_fprint(f, s);
+            break;
+        }
+        // val_s(s->val) is the "{" token of the closure text,
+        // which points to the matching "}" token.
+        stack_t t = val_s(s->val);
+        stack_t end = val_s(t->val);
         fputc('{', f);
-        stack_t s = v.val.s;
-        // Formal parameters are preceded by their marker ('!' or NONE)
-        for (stack_t fp = s->val.val.s; fp != NULL; fp = fp->next) {
-            fputc((fp->val.type == '!') ? '!' : ' ', f);
-            fp = fp->next;
-            fputs(fp->val.val.t, f);
+        // Formal parameters are preceded by their marker ('!' or ' ')
+        for (t = t->next; val_type(t->val) != ':'; t = t->next) {
+            if (val_type(t->val) == '!') {
+                fputc('!', f);
+                t = t->next;
+            } else {
+                fputc(' ', f);
+            }
+            val_fprint(f, t->val);
         }
         fputc(':', f);
-        s = s->next;
         // The body is printed with no commas to separate items
-        for (stack_t b = s->val.val.s; b != NULL; b = b->next) {
+        for (t = t->next; t != end; t = t->next) {
             fputc(' ', f);
-            val_fprint(f, b->val);
+            val_fprint(f, t->val);
         }
         fputc('|', f);
-        s = s->next;
-        //val_list_fprint(f, s->val.val.s);
         fputc('}', f);
         break;
     }
     default:
-        fputc((v.type > 32 && v.type < 128) ? v.type : '?', f);
+        fputc((val_type(v) > 32 && val_type(v) < 128) ? val_type(v) : '?', f);
     }
 }
@@ -0,0 +1,75 @@
+/*  Microbenchmark of awful_find: compile it as
+
+        gcc -O2 awful_find_test.c ../src/awful_key.c ../src/except.c
+            ../src/image.c ../src/scan.c ../src/secd.c ../src/stack.c
+            ../src/str.c ../src/val.c -lm
+
+    For environments of increasing depth and width, it measures
+    the time needed to look up the worst placed variable, thus
+    the first one bound by the outermost frame, comparing names
+    by strcmp, by address and by address with indexed frames. */
+
+#include "../src/awful.c"    // YES! .c
+
+#include <time.h>
+
+#define MAXDEPTH (64)
+#define MAXWIDTH (64)
+#define LOOKUPS (1 << 20)
+
+/** Same as awful_find, but comparing names by strcmp, as done
+    by older versions. */
+static val_t find_strcmp(char *t, stack_t e)
+{
+    for (; e != NULL; e = e->next)
+        for (stack_t p = val_s(e->val); p != NULL; p = p->next->next)
+            if (strcmp(t, val_str(p->val)) == 0)
+                return p->next->val;
+    return VAL_NONE;
+}
+
+/** Create an environment of depth frames binding width variables
+    each: if index != 0 then frames are created by awful_frame. */
+static stack_t make_env(int depth, int width, int index)
+{
+    stack_t env = NULL;
+    char name[32];
+    for (int d = 0; d < depth; ++ d) {
+        stack_t assoc = NULL;
+        for (int w = width - 1; w >= 0; -- w) {
+            assoc = stack_push(assoc, val_number(w));
+            sprintf(name, "v%i_%i", d, w);
+            assoc = stack_push(assoc, val_make(ATOM, str_new(name, strlen(name))));
+        }
+        env = (index) ? awful_frame(env, assoc, width)
+            : stack_push_s(env, assoc);
+    }
+    return env;
+}
+
+/** Return the nanoseconds needed by a single lookup of t in e. */
+static double bench(val_t (*find)(char*, stack_t), char *t, stack_t e)
+{
+    double sum = 0;
+    clock_t c = clock();
+    for (int i = 0; i < LOOKUPS; ++ i)
+        sum += val_n(find(t, e));
+    c = clock() - c;
+    if (sum != 0) puts("BUG: wrong value found");
+    return 1e9 * c / CLOCKS_PER_SEC / LOOKUPS;
+}
+
+int main(void)
+{
+    puts("depth width  strcmp(ns)  address(ns)  indexed(ns)");
+    for (int depth = 1; depth <= MAXDEPTH; depth *= 4)
+        for (int width = 2; width <= MAXWIDTH; width *= 2) {
+            char *t = str_new("v0_0", 4);
+            stack_t e1 = make_env(depth, width, 0);
+            stack_t e2 = make_env(depth, width, 1);
+            printf("%5i %5i %11.1f %12.1f %12.1f\n", depth, width,
+                bench(find_strcmp, t, e1), bench(awful_find, t, e1),
+                bench(awful_find, t, e2));
+            stack_reset();
+        }
+}
@@ -0,0 +1,52 @@
+/*  Benchmark of the translation cache: compile it as
+
+        gcc -O2 cache_test.c ../src/awful.c ../src/awful_key.c
+            ../src/cache.c ../src/except.c ../src/image.c ../src/nice.c
+            ../src/scan.c ../src/secd.c ../src/stack.c ../src/str.c
+            ../src/val.c -lm
+
+    It evaluates ROUNDS times a batch of LINES distinct Niceful
+    lines, as happens to a batch file which applies the same
+    expressions to different data, and prints the time needed by
+    each line without cache, with a cache holding all lines and
+    with a cache holding about a third of them, which the order of
+    the lines makes useless, and the statistics of the cache. */
+
+#include <stdio.h>
+#include <time.h>
+#include "../header/cache.h"
+#include "../header/nice.h"
+
+#define LINES (1000)
+#define ROUNDS (50)
+
+/** Return the microseconds needed to evaluate each line when
+    the cache budget is the given number of bytes. */
+static double bench(size_t bytes, FILE *out)
+{
+    char line[512];
+    cache_set_budget(bytes);
+    clock_t c = clock();
+    for (int r = 0; r < ROUNDS; ++ r)
+        for (int i = 0; i < LINES; ++ i) {
+            sprintf(line, "let data%i = [%i, 2, 3, 4] in letrec "
+                "len = fun x: if empty x then 0 else 1 + len(rest x), "
+                "sum = fun x: if empty x then 0 else 1st x + sum(rest x) "
+                "in if len(data%i) > 3 then sum(data%i) * 2 else 0",
+                i, i, i, i);
+            nice(line, out);
+        }
+    c = clock() - c;
+    return 1e6 * c / CLOCKS_PER_SEC / LINES / ROUNDS;
+}
+
+int main(void)
+{
+    FILE *out = fopen("/dev/null", "w");
+    printf("no cache: %.2f us per line\n", bench(0, out));
+    printf("cache:    %.2f us per line\n", bench(CACHE_BUDGET, out));
+    cache_status(stdout);
+    printf("third:    %.2f us per line\n", bench(512 << 10, out));
+    cache_status(stdout);
+    fclose(out);
+}
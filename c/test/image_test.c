@@ -0,0 +1,67 @@
+/*  Benchmark of images: compile it as
+
+        gcc -O2 image_test.c ../src/awful.c ../src/awful_key.c
+            ../src/cache.c ../src/except.c ../src/image.c ../src/nice.c
+            ../src/scan.c ../src/secd.c ../src/stack.c ../src/str.c
+            ../src/val.c -lm
+
+    For preludes defining 10^2 up to 10^4 functions, it measures
+    the time needed to load the Niceful source by nice_prelude(),
+    which scans, translates, compiles and binds it, and the time
+    needed to load the image saved after it by image_load(), then
+    prints the value of a call of the last function defined. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../header/awful.h"
+#include "../header/image.h"
+#include "../header/nice.h"
+
+#define MAXDEFS (10000)
+#define IMAGE "/tmp/image_test.img"
+
+/** Return the source of a prelude defining n functions. */
+static char *source(int n)
+{
+    char *s = malloc(n * 128 + 64), *p = s;
+    p += sprintf(p, "letrec ");
+    for (int i = 0; i < n; ++ i)
+        p += sprintf(p, "f%i = fun x y: if x < 1 then \"s%i\" "
+            "else f%i(x - 1, [y, %i.5]),\n", i, i, (i > 0) ? i - 1 : 0, i);
+    sprintf(p, "g = fun x: f%i(x, [])\nin 0", n - 1);
+    return s;
+}
+
+/** Return the milliseconds elapsed since c. */
+static double ms(clock_t c)
+{
+    return 1e3 * (clock() - c) / CLOCKS_PER_SEC;
+}
+
+int main(void)
+{
+    FILE *out = fopen("/dev/null", "w");
+    puts("    defs  source(ms)   image(ms)  image(Kbytes)");
+    for (int n = 100; n <= MAXDEFS; n *= 10) {
+        char *s = source(n);
+        awful_prelude_drop();
+        clock_t c = clock();
+        nice_prelude(s, out);
+        double t_source = ms(c);
+        free(s);
+        image_save(IMAGE);
+        c = clock();
+        image_load(IMAGE);
+        double t_image = ms(c);
+        FILE *f = fopen(IMAGE, "rb");
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fclose(f);
+        printf("%8i %11.2f %11.2f %14.1f\n", n, t_source, t_image,
+            size / 1024.0);
+        nice("g(3)", stdout);
+    }
+    remove(IMAGE);
+    fclose(out);
+}
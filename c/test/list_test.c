@@ -0,0 +1,76 @@
+/*  Checks and benchmark of the list keywords: compile it as
+
+        gcc -O2 list_test.c ../src/awful.c ../src/awful_key.c
+            ../src/cache.c ../src/except.c ../src/image.c ../src/nice.c
+            ../src/scan.c ../src/secd.c ../src/stack.c ../src/str.c
+            ../src/val.c -lm
+
+    and run it inside this directory. It checks LEN, NTH, APPEND
+    and REVERSE with both engines, then times the functions of the
+    list prelude which call them against the recursive definitions
+    they replaced. It returns the number of failed checks. */
+
+#include "nice_test.h"
+
+#define RUNS (5)
+
+/** Niceful lines using the list keywords and what they should
+    print. */
+static char *checks[][2] = {
+    {"LEN([1, [2, 3], \"a\"])", "3"},
+    {"LEN(nil)", "0"},
+    {"LEN(3)", "! LEN x needs x to be a stack"},
+    {"NTH([10, 20, 30], 0)", "10"},
+    {"NTH([10, 20, 30], 2)", "30"},
+    {"NTH([10, 20, 30], 3)", "! Index out of range"},
+    {"NTH([10, 20, 30], -1)", "! Index out of range"},
+    {"NTH([10, 20, 30], 0.5)", "! Index out of range"},
+    {"NTH(nil, 0)", "! Index out of range"},
+    {"NTH(5, 0)", "! NTH x n needs x to be a stack"},
+    {"APPEND([1, 2], [3])", "[1,2,3]"},
+    {"APPEND(nil, [3])", "[3]"},
+    {"APPEND([1], nil)", "[1]"},
+    {"APPEND(nil, nil)", "[]"},
+    {"let x = [1, 2] in APPEND(x, x)", "[1,2,1,2]"},
+    {"APPEND(1, nil)", "! APPEND x y needs x and y to be stacks"},
+    {"REVERSE([1, 2, 3])", "[3,2,1]"},
+    {"REVERSE([[1, 2]])", "[[1,2]]"},
+    {"REVERSE(nil)", "[]"},
+    {"REVERSE(\"a\")", "! REVERSE x needs x to be a stack"},
+};
+
+/** The recursive definitions of the list prelude, prefixed by p. */
+static char *recursive =
+    "letrec "
+    "plen = fun x: if empty x then 0 else 1 + plen(rest x),"
+    "pnth = fun x n:"
+    "    if empty x or n < 0 then \"Index out of range\""
+    "    else if n = 0 then 1st x else pnth(rest x, n - 1),"
+    "pappend = fun x1 x2:"
+    "    if empty x1 then x2"
+    "    else if empty rest x1 then 1st x1 : x2"
+    "    else 1st x1 : pappend(rest x1, x2),"
+    "preverse = fun x:"
+    "    if empty x then nil else pappend(preverse(rest x), [1st x])"
+    " in plen";
+
+/** Each function, recursive and native, which is quadratic or too
+    deep on long lists if recursive. */
+static nice_test_row_t rows[] = {
+    {"len", 1, {"plen(L)", "len(L)"}, {10000, 1000000}},
+    {"nth", 1, {"pnth(L, N - 1)", "nth(L, N - 1)"}, {10000, 1000000}},
+    {"append", 1, {"1st pappend(L, L)", "1st append(L, L)"}, {10000, 1000000}},
+    {"reverse", 1, {"1st preverse(L)", "1st reverse(L)"}, {1000, 1000000}},
+};
+
+int main(void)
+{
+    nice_checks(checks, sizeof(checks) / sizeof(*checks));
+    FILE *out = fopen("/dev/null", "w");
+    nice_test_prelude("../../preludes/list.pre", out);
+    nice_prelude(recursive, out);
+    nice_test_table("   length  function     recursive        native",
+        rows, sizeof(rows) / sizeof(*rows), 1000, 1000000, 10, RUNS, out);
+    fclose(out);
+    return nice_test_report();
+}
@@ -0,0 +1,81 @@
+/*  Checks and benchmark of the higher order keywords: compile it as
+
+        gcc -O2 map_test.c ../src/awful.c ../src/awful_key.c
+            ../src/cache.c ../src/except.c ../src/image.c ../src/nice.c
+            ../src/scan.c ../src/secd.c ../src/stack.c ../src/str.c
+            ../src/val.c -lm
+
+    and run it inside this directory. It checks that MAP, FILTER
+    and FOLD give the same results with both engines, then times
+    map, filter and fold of the numerical prelude against the
+    recursive definitions they replaced. It returns the number of
+    failed checks. */
+
+#include "nice_test.h"
+
+#define RUNS (5)
+
+/** Niceful lines using the higher order keywords and what they
+    should print. */
+static char *checks[][2] = {
+    {"MAP(fun x: x * 2, [1, 2, 3])", "[2,4,6]"},
+    {"MAP(fun x: x : nil, [1, 2])", "[[1],[2]]"},
+    {"MAP(fun x: x, nil)", "[]"},
+    {"MAP(fun x: FOLD(fun a y: a + y, 0, x), [[1, 2], nil, [3]])",
+        "[3,0,3]"},
+    {"MAP(fun x: 1st x, [[1], 2])", "! TOS x needs x to be a stack"},
+    {"MAP(fun x y: x, [1])", "! 2 actual parameters expected"},
+    {"MAP(3, [1])", "! Function expected"},
+    {"MAP(fun x: x, 3)", "! MAP f x needs x to be a stack"},
+    {"FILTER(fun x: x > 1, [1, 2, 3])", "[2,3]"},
+    {"FILTER(fun x: 0, [1, 2])", "[]"},
+    {"FILTER(fun x: x, nil)", "[]"},
+    {"FILTER(fun x: 1st x, [[1], 2])", "! TOS x needs x to be a stack"},
+    {"FILTER(fun x: \"a\", [1])",
+        "! FILTER f x needs f to return numbers"},
+    {"FILTER(fun x: x, 2)", "! FILTER f x needs x to be a stack"},
+    {"FOLD(fun a x: a + x, 0, [1, 2, 3])", "6"},
+    {"FOLD(fun a x: x : a, nil, [1, 2, 3])", "[3,2,1]"},
+    {"FOLD(fun a x: a + x, 7, nil)", "7"},
+    {"FOLD(fun a x: a + 1st x, 0, [[1], 2])",
+        "! TOS x needs x to be a stack"},
+    {"FOLD(fun a: a, 0, [1])", "! 1 actual parameters expected"},
+    {"FOLD(fun a x: a, 0, 5)", "! FOLD f z x needs x to be a stack"},
+};
+
+/** The recursive definitions of the numerical prelude, prefixed
+    by p. */
+static char *recursive =
+    "letrec "
+    "pmap = fun f x:"
+    "    if empty x then nil else f(1st x) : pmap(f, rest x),"
+    "pfilter = fun f x:"
+    "    if empty x then nil"
+    "    else if f(1st x) then 1st x : pfilter(f, rest x)"
+    "    else pfilter(f, rest x),"
+    "pfold = fun f z x:"
+    "    if empty x then z else pfold(f, f(z, 1st x), rest x)"
+    " in pmap";
+
+/** Each function, recursive and native, which is too deep on
+    long lists if recursive. */
+static nice_test_row_t rows[] = {
+    {"map", 1, {"1st pmap(fun x: x + 1, L)", "1st map(fun x: x + 1, L)"},
+        {100000, 1000000}},
+    {"filter", 1, {"1st pfilter(fun x: x > N / 2, L)",
+        "1st filter(fun x: x > N / 2, L)"}, {100000, 1000000}},
+    {"fold", 1, {"pfold(fun z x: z + x, 0, L)", "fold(fun z x: z + x, 0, L)"},
+        {1000000, 1000000}},
+};
+
+int main(void)
+{
+    nice_checks(checks, sizeof(checks) / sizeof(*checks));
+    FILE *out = fopen("/dev/null", "w");
+    nice_test_prelude("../../preludes/num.pre", out);
+    nice_prelude(recursive, out);
+    nice_test_table("   length  function     recursive        native",
+        rows, sizeof(rows) / sizeof(*rows), 1000, 1000000, 10, RUNS, out);
+    fclose(out);
+    return nice_test_report();
+}
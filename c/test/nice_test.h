@@ -0,0 +1,180 @@
+/** \file nice_test.h */
+
+/** Helpers shared by the tests which evaluate Niceful text: they
+    are static inline, so that the compile line of a test only
+    needs the sources of the interpreter and a test may use some
+    of them only. */
+
+#ifndef nice_test_INC
+#define nice_test_INC
+
+// fileno(), dup() and dup2() are POSIX, not C99
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+// unistd.h declares the nice() of POSIX, which nice.h replaces
+#define nice posix_nice
+#include <unistd.h>
+#undef nice
+#include "../header/awful.h"
+#include "../header/nice.h"
+#include "../header/str.h"
+
+/** Number of checks done by nice_check(), and of failed ones. */
+static int nice_test_checks = 0, nice_test_failed = 0;
+
+/** Load the prelude in the file name, of any length. */
+static inline void nice_test_prelude(char *name, FILE *out)
+{
+    FILE *f = fopen(name, "r");
+    size_t size;
+    char *text = (f == NULL) ? NULL : str_map(f, &size);
+    if (f != NULL) fclose(f);
+    if (text == NULL) {
+        perror(name);
+        exit(1);
+    }
+    nice_prelude(text, out);
+    str_unmap(text, size);
+}
+
+/** Return the ms needed to evaluate runs times the expression e. */
+static inline double nice_test_bench(char *e, int runs, FILE *out)
+{
+    clock_t c = clock();
+    for (int r = 0; r < runs; ++ r)
+        nice(e, out);
+    return 1e3 * (clock() - c) / CLOCKS_PER_SEC / runs;
+}
+
+/** Evaluate the Niceful line e by the engine and write into r,
+    of size n, what it prints: the value, or "! " followed by the
+    error message if it raises an exception. */
+static inline void nice_test_eval(char *e, int engine, char *r, size_t n)
+{
+    FILE *out = tmpfile(), *err = tmpfile();
+    if (out == NULL || err == NULL) {
+        perror("tmpfile");
+        exit(1);
+    }
+    // Error messages are written on the unbuffered stderr
+    int fd = dup(2);
+    dup2(fileno(err), 2);
+    awful_engine = engine;
+    int failed = nice(e, out);
+    dup2(fd, 2);
+    close(fd);
+    FILE *f = failed ? err : out;
+    if (failed) {
+        strcpy(r, "! ");
+        r += 2;
+        n -= 2;
+    }
+    rewind(f);
+    size_t k = fread(r, 1, n - 1, f);
+    while (k > 0 && r[k - 1] == '\n')
+        -- k;
+    r[k] = '\0';
+    fclose(out);
+    fclose(err);
+    awful_engine = AWFUL_SECD;
+}
+
+/** Check that both engines print expected evaluating the Niceful
+    line e, reporting on stdout each engine which does not. */
+static inline void nice_check(char *e, char *expected)
+{
+    static char *names[] = {"eval", "secd"};
+    static int engines[] = {AWFUL_EVAL, AWFUL_SECD};
+    char r[256];
+    for (int i = 0; i < 2; ++ i) {
+        ++ nice_test_checks;
+        nice_test_eval(e, engines[i], r, sizeof(r));
+        if (strcmp(r, expected) != 0) {
+            ++ nice_test_failed;
+            printf("FAILED by %s: %s\n  expected: %s\n  printed:  %s\n",
+                names[i], e, expected, r);
+        }
+    }
+}
+
+/** Do by nice_check() the n checks, each one a Niceful line and
+    what it should print. */
+static inline void nice_checks(char *checks[][2], unsigned n)
+{
+    for (unsigned i = 0; i < n; ++ i)
+        nice_check(checks[i][0], checks[i][1]);
+}
+
+/** Bind by a prelude N to n and L to a list literal of n numbers,
+    0, ..., n - 1 if sorted, else random ones below 10^6, which
+    are the same at each call. */
+static inline void nice_test_list(int n, int sorted, FILE *out)
+{
+    char *line = malloc((size_t) n * 8 + 64);
+    if (line == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    int k = sprintf(line, "let N = %i, L = [", n);
+    srand(1);
+    for (int i = 0; i < n; ++ i)
+        k += sprintf(line + k, (i > 0) ? ",%i" : "%i",
+            sorted ? i : rand() % 1000000);
+    sprintf(line + k, "] in N");
+    nice_prelude(line, out);
+    free(line);
+}
+
+/// Max number of expressions timed on a row of nice_test_table()
+#define NICE_TEST_COLS (3)
+
+/** Row of nice_test_table(): the expressions timed on L, bound
+    by nice_test_list(), and the max length of L to time each. */
+typedef struct {
+    char *name;
+    int sorted;
+    char *exprs[NICE_TEST_COLS];
+    int max[NICE_TEST_COLS];
+} nice_test_row_t;
+
+/** Print head and, for each length of L from first up to last,
+    multiplied by step each time, and each one of the n rows, a
+    line with the length, the name of the row and the ms needed
+    by its expressions, or "-" where L is too long for them. */
+static inline void nice_test_table(char *head, nice_test_row_t *rows,
+    unsigned n, int first, int last, int step, int runs, FILE *out)
+{
+    puts(head);
+    for (int len = first; len <= last; len *= step) {
+        int sorted = -1;
+        for (unsigned i = 0; i < n; ++ i) {
+            if (rows[i].sorted != sorted)
+                nice_test_list(len, sorted = rows[i].sorted, out);
+            printf("%9i  %-8s", len, rows[i].name);
+            for (int j = 0; j < NICE_TEST_COLS; ++ j) {
+                char *e = rows[i].exprs[j];
+                if (e == NULL) break;
+                if (len <= rows[i].max[j])
+                    printf("%11.3f ms", nice_test_bench(e, runs, out));
+                else
+                    printf("%14s", "-");
+            }
+            putchar('\n');
+        }
+    }
+}
+
+/** Print how many checks failed and return it, as exit code. */
+static inline int nice_test_report(void)
+{
+    printf("%i checks, %i failed\n", nice_test_checks, nice_test_failed);
+    return nice_test_failed;
+}
+
+#endif
@@ -0,0 +1,131 @@
+/*  Benchmark of scan(): compile it as
+
+        gcc -O2 scan_test.c ../src/awful.c ../src/except.c
+            ../src/image.c ../src/secd.c ../src/stack.c ../src/str.c
+            ../src/val.c -lm
+
+    It generates a large Awful source and measures the speed in
+    Mbytes per second of scan(), comparing it with the scanner
+    of older versions, which classified characters by strchr()
+    and isspace(), tried strtod() on each atom and looked for
+    keywords by comparing them with all names. */
+
+#include "../src/awful_key.c"   // YES! .c
+#include "../src/scan.c"        // YES! .c
+
+#include <ctype.h>
+#include <stdio.h>
+#include <time.h>
+
+/// Size of the generated source
+#define SOURCE (8 << 20)
+#define RUNS (5)
+
+/** Keyword lookup of older versions. */
+static void *old_key_find(char *t, unsigned n)
+{
+    return
+        (n == 2) ? (
+            (t[0] == 'E' && t[1] == 'Q') ? &EQ_key:
+            (t[0] == 'G' && t[1] == 'E') ? &GE_key:
+            (t[0] == 'G' && t[1] == 'T') ? &GT_key:
+            (t[0] == 'L' && t[1] == 'E') ? &LE_key:
+            (t[0] == 'L' && t[1] == 'T') ? &LT_key:
+            (t[0] == 'N' && t[1] == 'E') ? &NE_key: NULL) :
+        (n == 3) ? (
+            (t[0] == 'A' && t[1] == 'D' && t[2] == 'D') ? &ADD_key:
+            (t[0] == 'B' && t[1] == 'O' && t[2] == 'S') ? &BOS_key:
+            (t[0] == 'D' && t[1] == 'I' && t[2] == 'V') ? &DIV_key:
+            (t[0] == 'M' && t[1] == 'A' && t[2] == 'X') ? &MAX_key:
+            (t[0] == 'M' && t[1] == 'I' && t[2] == 'N') ? &MIN_key:
+            (t[0] == 'M' && t[1] == 'U' && t[2] == 'L') ? &MUL_key:
+            (t[0] == 'N' && t[1] == 'I' && t[2] == 'L') ? &NIL_key:
+            (t[0] == 'P' && t[1] == 'O' && t[2] == 'W') ? &POW_key:
+            (t[0] == 'S' && t[1] == 'U' && t[2] == 'B') ? &SUB_key:
+            (t[0] == 'T' && t[1] == 'O' && t[2] == 'S') ? &TOS_key: NULL) :
+        (n == 4) ? (
+            (t[0] == 'C' && t[1] == 'O' && t[2] == 'N' && t[3] == 'D') ? &COND_key:
+            (t[0] == 'P' && t[1] == 'U' && t[2] == 'S' && t[3] == 'H') ? &PUSH_key: NULL) :
+        (n == 5) ? (
+            (t[0] == 'I' && t[1] == 'S' && t[2] == 'N' && t[3] == 'I' && t[4] == 'L') ? &ISNIL_key: NULL)
+        : NULL;
+}
+
+/** Scanner of older versions. */
+static stack_t old_scan(char *text, char *delims, void *key_find(char*,unsigned))
+{
+    val_t v;
+    stack_t tokens = NULL;
+    while (*text != '\0') {
+        text += strspn(text, " \t\n\r");    // skip spaces
+        if (*text == '\0') break;
+        if (*text == '\\') {    // Skip until the end of the line
+            if ((text = strchr(text + 1, '\n')) == NULL) break;
+            continue;
+        }
+        if (strchr(delims, *text) != NULL) {
+            v = val_make(*text, NULL);
+            tokens = stack_push(tokens, v);
+            ++ text;
+        } else
+        if (*text == '\'' || *text == '"') {
+            char q = *text;
+            char *p = strchr(text + 1, q);
+            except_on(p == NULL, "End of text inside string");
+            v = val_make(STRING, str_new(text + 1, p - text - 1));
+            tokens = stack_push(tokens, v);
+            text = p + 1;
+        } else {
+            char *p = text++;
+            while (*text != '\0' && !isspace(*text)
+            && strchr(delims, *text) == NULL && *text != '\''
+            && *text != '"')
+                ++ text;
+            char *q;
+            v = val_number(strtod(p, &q));
+            if (q != text) {
+                void *k = key_find(p, text - p);
+                v = (k != NULL) ? val_make(KEYWORD, k)
+                    : val_make(ATOM, str_new(p, text - p));
+            }
+            tokens = stack_push(tokens, v);
+        }
+    }
+    return scan_match(stack_reverse(tokens));
+}
+
+/** Return a string of about SOURCE bytes containing Awful code. */
+static char *source(void)
+{
+    char *s = malloc(SOURCE + 256);
+    except_on(s == NULL, "Cannot allocate source");
+    size_t n = 0;
+    for (int i = 0; n < SOURCE; ++ i)
+        n += sprintf(s + n, "({!fact%i:(fact%i %i)}{n:(COND LE n 1"
+            "{:1}{:MUL n (fact%i SUB n 1)})}) \\ factorial %i\n"
+            "(PUSH 'item%i' PUSH %i.25 PUSH 1e%i NIL)\n",
+            i % 1000, i % 1000, i, i % 1000, i, i % 100, i, i % 300);
+    return s;
+}
+
+/** Return the speed in Mbytes per second of the scanner
+    scan_f applied to the string s. */
+static double bench(stack_t (*scan_f)(char*, char*, void*(char*,unsigned)),
+    void *key_find(char*,unsigned), char *s)
+{
+    clock_t c = clock();
+    scan_f(s, "(){},:!", key_find);
+    c = clock() - c;
+    stack_reset();
+    return (double) strlen(s) / (1 << 20) / c * CLOCKS_PER_SEC;
+}
+
+int main(void)
+{
+    char *s = source();
+    puts("old (MB/s)  new (MB/s)");
+    for (int i = 0; i < RUNS; ++ i)
+        printf("%10.1f  %10.1f\n", bench(old_scan, old_key_find, s),
+            bench(scan, awful_key_find, s));
+    free(s);
+}
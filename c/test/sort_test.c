@@ -0,0 +1,74 @@
+/*  Checks and benchmark of the sort keywords: compile it as
+
+        gcc -O2 sort_test.c ../src/awful.c ../src/awful_key.c
+            ../src/cache.c ../src/except.c ../src/image.c ../src/nice.c
+            ../src/scan.c ../src/secd.c ../src/stack.c ../src/str.c
+            ../src/val.c -lm
+
+    and run it inside this directory. It checks SORT and SORTBY
+    with both engines, then times sort and sortby of the list
+    prelude against its quicksort, on random and sorted lists.
+    It returns the number of failed checks. */
+
+#include "nice_test.h"
+
+#define RUNS (3)
+
+/** Niceful lines using the sort keywords and what they should
+    print. */
+static char *checks[][2] = {
+    {"SORT([3, 1, 2])", "[1,2,3]"},
+    {"SORT([2, -1, 2, 0.5])", "[-1,0.5,2,2]"},
+    {"SORT([\"b\", \"a\", \"c\"])", "['a','b','c']"},
+    {"SORT(nil)", "[]"},
+    {"SORT([5])", "[5]"},
+    {"SORT([1, \"a\"])",
+        "! SORT x needs x to contain only numbers or only strings"},
+    {"SORT([\"a\", 1])",
+        "! SORT x needs x to contain only numbers or only strings"},
+    {"SORT([[1]])",
+        "! SORT x needs x to contain only numbers or only strings"},
+    {"SORT(3)", "! SORT x needs x to be a stack"},
+    {"SORTBY(fun a b: a > b, [1, 3, 2])", "[3,2,1]"},
+    {"SORTBY(fun a b: 1st a < 1st b, [[2, 1], [1, 1], [2, 2], [1, 2], [0, 9]])",
+        "[[0,9],[1,1],[1,2],[2,1],[2,2]]"},
+    {"SORTBY(fun a b: 1st a > 1st b, [[2, 1], [1, 1], [2, 2], [1, 2], [0, 9]])",
+        "[[2,1],[2,2],[1,1],[1,2],[0,9]]"},
+    {"SORTBY(fun a b: 1st a < 1st b, [[3, \"a\"], [1, \"b\"], "
+        "[3, \"c\"], [2, \"d\"], [1, \"e\"], [3, \"f\"], [2, \"g\"], "
+        "[1, \"h\"], [2, \"i\"]])",
+        "[[1,'b'],[1,'e'],[1,'h'],[2,'d'],[2,'g'],[2,'i'],"
+        "[3,'a'],[3,'c'],[3,'f']]"},
+    // Collections happen during the comparisons of a long list
+    {"letrec mk = fun n l: if n = 0 then l else mk(n - 1, n : l) in "
+        "FOLD(fun a x: if x < a then x else 0, 20001, "
+        "SORTBY(fun a b: a > b, mk(20000, nil)))", "1"},
+    {"SORTBY(fun a b: a < b, nil)", "[]"},
+    {"SORTBY(fun a b: a < b, [7])", "[7]"},
+    {"SORTBY(fun a b: \"x\", [1, 2])",
+        "! SORTBY f x needs f to return numbers"},
+    {"SORTBY(fun a b: 1st a, [1, 2])", "! TOS x needs x to be a stack"},
+    {"SORTBY(fun a: a, [1, 2])", "! 1 actual parameters expected"},
+    {"SORTBY(fun a b: a < b, 3)", "! SORTBY f x needs x to be a stack"},
+};
+
+/** The sorts of random and sorted lists: quicksort is too slow
+    or too deep on long lists, above all on sorted ones. */
+static nice_test_row_t rows[] = {
+    {"random", 0, {"1st quicksort(L)", "1st sort(L)",
+        "1st sortby(fun x y: x < y, L)"}, {100000, 1000000, 1000000}},
+    {"sorted", 1, {"1st quicksort(L)", "1st sort(L)",
+        "1st sortby(fun x y: x < y, L)"}, {1000, 1000000, 1000000}},
+};
+
+int main(void)
+{
+    nice_checks(checks, sizeof(checks) / sizeof(*checks));
+    FILE *out = fopen("/dev/null", "w");
+    nice_test_prelude("../../preludes/list.pre", out);
+    nice_test_table("   length  order        quicksort"
+        "          sort        sortby", rows, sizeof(rows) / sizeof(*rows),
+        1000, 1000000, 10, RUNS, out);
+    fclose(out);
+    return nice_test_report();
+}
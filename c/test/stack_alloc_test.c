@@ -0,0 +1,41 @@
+/*  Benchmark of stack item allocation: compile it as
+
+        gcc -O2 stack_alloc_test.c ../src/awful.c ../src/awful_key.c
+            ../src/except.c ../src/image.c ../src/scan.c ../src/secd.c
+            ../src/stack.c ../src/str.c ../src/val.c -lm
+
+    It pushes 10^7 items on a stack, printing the time needed by
+    each million of them, which should not depend on the number
+    of items already allocated; next it does the same after a
+    stack_reset(), reusing the current chunk. */
+
+#include <stdio.h>
+#include <time.h>
+#include "../header/stack.h"
+
+#define SLICES (10)
+#define SLICE (1000000)
+
+/** Push SLICES * SLICE items on a stack and print the time
+    needed by each slice of them. */
+static void bench(void)
+{
+    stack_t s = NULL;
+    for (int i = 0; i < SLICES; ++ i) {
+        clock_t c = clock();
+        for (int j = 0; j < SLICE; ++ j) {
+            s = stack_push(s, val_number(j));
+        }
+        c = clock() - c;
+        printf("%2i x 10^6 items: %.2f ns/item\n", i + 1,
+            1e9 * c / CLOCKS_PER_SEC / SLICE);
+    }
+    stack_status(stdout);
+}
+
+int main(void)
+{
+    bench();
+    stack_reset();
+    bench();
+}
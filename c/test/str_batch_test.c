@@ -0,0 +1,36 @@
+/*  Benchmark of a large batch of Niceful lines: compile it as
+
+        gcc -O2 str_batch_test.c ../src/awful.c ../src/awful_key.c
+            ../src/cache.c ../src/except.c ../src/image.c ../src/nice.c
+            ../src/scan.c ../src/secd.c ../src/stack.c ../src/str.c
+            ../src/val.c -lm
+
+    It evaluates LINES lines, each one binding names which are
+    partly new and partly seen by recent lines, as happens to a
+    long batch file, and prints the time needed by each line,
+    which is mostly spent scanning and translating it, thus
+    creating strings, and the status of the string table. */
+
+#include <stdio.h>
+#include <time.h>
+#include "../header/nice.h"
+#include "../header/str.h"
+
+#define LINES (200000)
+
+int main(void)
+{
+    FILE *out = fopen("/dev/null", "w");
+    char line[256];
+    clock_t c = clock();
+    for (int i = 0; i < LINES; ++ i) {
+        sprintf(line, "let alpha%i = %i, beta%i = \"s%i\" in "
+            "letrec f = fun x: if x < 1 then alpha%i else f(x - 1) "
+            "in f(3) + alpha%i", i, i, i % 64, i, i, i);
+        nice(line, out);
+    }
+    c = clock() - c;
+    printf("%.2f us per line\n", 1e6 * c / CLOCKS_PER_SEC / LINES);
+    str_status(stdout);
+    fclose(out);
+}
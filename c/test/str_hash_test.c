@@ -1,37 +1,55 @@
+/*  Benchmark of the string table: compile it as
+
+        gcc -O2 str_hash_test.c ../src/except.c
+
+    For tables of 10^3 up to 10^7 distinct strings, it measures
+    the time needed to insert each string by str_new, and then
+    to look it up again, and prints the average length of the
+    non empty lists of the table. */
+
 #include "../src/str.c"    // YES! .c
 
-#include <math.h>
 #include <stdio.h>
+#include <time.h>
+
+#define MAXSTRINGS (10000000)
+
+/** Write into buffer the i-th test string and return its
+    length: strings look like identifiers of various length. */
+static int key(char *buffer, unsigned i)
+{
+    return sprintf(buffer, "%.*s%u", (int) (i % 7), "abcdefg", i);
+}
 
-#define MAXSIZ (31)
+/** Return the nanoseconds needed to insert (or lookup) each
+    of the first n test strings, not counting the time needed
+    to create them. */
+static double bench(unsigned n)
+{
+    char buffer[32];
+    clock_t c0 = clock();
+    for (unsigned i = 0; i < n; ++ i)
+        key(buffer, i);
+    clock_t c = clock();
+    for (unsigned i = 0; i < n; ++ i)
+        str_new(buffer, key(buffer, i));
+    c = clock() - c - (c - c0);
+    return 1e9 * c / CLOCKS_PER_SEC / n;
+}
 
 int main(void)
-//int fake(void)
 {
-    int collisions[TABSIZE] = {0};
-    char buffer[MAXSIZ + 1];
-    const int N = TABSIZE * 256;
-
-    for (int n = 0; n < N; ++ n) {
-        // Generates a random string
-        int len = 1 + ((double) rand() / RAND_MAX) * (MAXSIZ - 2);
-        // Generates the string
-        for (int i = 0; i < len; ++ i)
-            buffer[i] = ((double) rand() / RAND_MAX) * (127-32) + 32;
-        buffer[len] = '\0';
-        ++ collisions[str_hash(buffer, len)];
-    }
-    double mean = (double) N / TABSIZE;
-    double min = N;
-    double max = 0;
-    double std = 0;
-    for (int n = 1; n < TABSIZE; ++ n) {
-        max = fmax(collisions[n], max);
-        min = fmin(collisions[n], min);
-        std += pow(collisions[n] - mean, 2);
+    puts("  strings   lists  insert(ns)  lookup(ns)  mean list");
+    for (unsigned n = 1000; n <= MAXSTRINGS; n *= 10) {
+        double insert = bench(n);
+        double lookup = bench(n);
+        unsigned used = 0;
+        for (unsigned i = 0; i < str_size; ++ i)
+            used += str_table[i] != NULL;
+        printf("%9u %7u %11.1f %11.1f %10.2f\n", str_count, str_size,
+            insert, lookup, (double) str_count / used);
+        // Free all strings
+        for (int i = 0; i <= STR_KEEP; ++ i)
+            str_reset();
     }
-    std = sqrt(std/TABSIZE);
-    printf("%i bucket, %i words (%.0f words/bucket)\n", TABSIZE, N, (double) N / TABSIZE);
-    printf("Min = %g < Mean = %g < Max = %g\n", min, mean, max);
-    printf("Stdev = %g\n", std);
 }
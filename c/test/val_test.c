@@ -0,0 +1,46 @@
+/*  Benchmark of list-heavy Niceful code: compile it as
+
+        gcc -O2 val_test.c ../src/awful.c ../src/awful_key.c
+            ../src/cache.c ../src/except.c ../src/image.c ../src/nice.c
+            ../src/scan.c ../src/secd.c ../src/stack.c ../src/str.c
+            ../src/val.c -lm
+
+    and run it inside this directory. After loading the list and
+    numerical preludes, it sorts, reverses, maps and filters a list
+    of LENGTH random numbers, bound by a prelude, and prints the
+    time needed by each expression, the size of a stack item, the
+    peak resident memory and the status of the collector, which
+    depend on the size of a value. */
+
+// Included first, since it asks for POSIX declarations
+#include "nice_test.h"
+#include <sys/resource.h>
+#include "../header/stack.h"
+
+#define LENGTH (3000)
+#define RUNS (5)
+
+/** Expressions applied to the list L. */
+static char *exprs[] = {
+    "len(quicksort(L))",
+    "len(reverse(L))",
+    "len(map(square, filter(fun x: x < 500000, L)))",
+    "len(append(L, append(L, L)))",
+};
+
+int main(void)
+{
+    FILE *out = fopen("/dev/null", "w");
+    nice_test_prelude("../../preludes/list.pre", out);
+    nice_test_prelude("../../preludes/num.pre", out);
+    nice_test_list(LENGTH, 0, out);
+    for (unsigned i = 0; i < sizeof(exprs) / sizeof(*exprs); ++ i)
+        printf("%8.2f ms  %s\n", nice_test_bench(exprs[i], RUNS, out),
+            exprs[i]);
+    struct rusage u;
+    getrusage(RUSAGE_SELF, &u);
+    printf("%zu bytes per item, %ld Kbytes peak resident memory\n",
+        sizeof(struct stack_s), u.ru_maxrss);
+    stack_status(stdout);
+    fclose(out);
+}
@@ -0,0 +1,59 @@
+/*  Benchmark of indexed access to lists and vectors: compile it as
+
+        gcc -O2 vec_test.c ../src/awful.c ../src/awful_key.c
+            ../src/cache.c ../src/except.c ../src/image.c ../src/nice.c
+            ../src/scan.c ../src/secd.c ../src/stack.c ../src/str.c
+            ../src/val.c -lm
+
+    and run it inside this directory. It checks vec, size, v[i]
+    and v[i, j] with both engines, then times the sum by index of
+    the elements of lists of increasing length, by nth() on the
+    list and by v[i] on a vector made from it. It returns the
+    number of failed checks. */
+
+#include "nice_test.h"
+
+#define RUNS (5)
+
+/** Niceful lines using vectors and what they should print. */
+static char *checks[][2] = {
+    {"vec [1, 2, 3]", "vec [1,2,3]"},
+    {"vec nil", "vec []"},
+    {"size vec [1, 2]", "2"},
+    {"size vec nil", "0"},
+    {"(vec [1, 2, 3])[0]", "1"},
+    {"(vec [1, 2, 3])[2]", "3"},
+    {"let v = vec [\"a\", [1]] in v[1]", "[1]"},
+    {"let v = vec [1, 2, 3, 4] in v[1, 3]", "vec [2,3]"},
+    {"let v = vec [1, 2, 3, 4] in v[0, 4]", "vec [1,2,3,4]"},
+    {"let v = vec [1, 2, 3, 4] in v[4, 4]", "vec []"},
+    {"(vec [1, 2, 3])[3]", "! Index out of range"},
+    {"(vec [1, 2, 3])[-1]", "! Index out of range"},
+    {"(vec [1, 2, 3])[0.5]", "! Index out of range"},
+    {"(vec nil)[0]", "! Index out of range"},
+    {"let v = vec [1, 2, 3, 4] in v[2, 1]", "! Index out of range"},
+    {"let v = vec [1, 2, 3, 4] in v[0, 5]", "! Index out of range"},
+    {"vec 3", "! VEC x needs x to be a stack"},
+    {"size [1, 2]", "! VLEN x needs x to be a vector"},
+    {"[1, 2][0]", "! VAT x n needs x to be a vector"},
+};
+
+/** Sums of the elements of the list L of N numbers by index. */
+static nice_test_row_t rows[] = {
+    {"sum", 0, {
+        "letrec s = fun i a: if i = N then a"
+        " else s(i + 1, a + nth(L, i)) in s(0, 0)",
+        "let V = vec L in letrec s = fun i a: if i = N then a"
+        " else s(i + 1, a + V[i]) in s(0, 0)"}, {10000, 10000}},
+};
+
+int main(void)
+{
+    nice_checks(checks, sizeof(checks) / sizeof(*checks));
+    FILE *out = fopen("/dev/null", "w");
+    nice_test_prelude("../../preludes/list.pre", out);
+    nice_test_table("   length  function     nth(L, i)          V[i]",
+        rows, sizeof(rows) / sizeof(*rows), 100, 3200, 2, RUNS, out);
+    fclose(out);
+    return nice_test_report();
+}